@@ -4,9 +4,16 @@
 #include <string>
 #include <functional>
 #include <numeric>
+#include <filesystem>
+#include <fstream>
 #include <future>
+#include <optional>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "benchmark.h"
+#include "threadPool.h"
+#include "primes.h"
+#include "telemetry.h"
 
 #ifdef PARALLEL_ENABLED
 #include <execution>
@@ -16,14 +23,6 @@ using namespace std;
 using namespace std::placeholders;
 using namespace std::chrono;
 
-auto measureExecutionTimeForF = [](auto f){
-    auto t1 = high_resolution_clock::now();
-    f();
-    auto t2 = high_resolution_clock::now();
-    chrono::nanoseconds duration = t2 - t1;
-    return duration;
-};
-
 template<typename DestinationType>
 auto transformAll = [](const auto& source, auto lambda){
     DestinationType result(source.size());
@@ -53,7 +52,7 @@ auto none_of_collection = [](auto aCollection, auto lambda){
     return none_of(aCollection.begin(), aCollection.end(), lambda);
 };
 
-auto is_prime = [](int x) {
+auto is_prime_trial_division = [](int x) {
     auto xIsDivisibleBy = bind(isDivisibleBy, x, _1);
     return none_of_collection(
             rangeFrom2To(x - 1), 
@@ -61,20 +60,26 @@ auto is_prime = [](int x) {
         );
 };
 
+auto is_prime = [](int x) {
+    return isPrime(x);
+};
+
 auto are_primes = [](auto aVector){
     return transformAll<vector<bool>>(aVector, is_prime);
 };
 
+auto are_primes_on_pool = [](ThreadPool& pool, const auto& aVector){
+    return parallelTransformAll<vector<bool>>(pool, aVector, is_prime);
+};
+
 auto isPrimeSequential = [](auto aVector){
-    auto sequentialDuration = measureExecutionTimeForF(bind(are_primes, aVector));
-    cout << "is prime sequential execution time:" << sequentialDuration.count() << " ns" << endl;
+    printDuration("is prime sequential execution time: ", bind(are_primes, aVector));
 };
 
 auto arePrimesAsync = [](auto aVector){
-    auto naiveAsyncDuration = measureExecutionTimeForF([&](){
+    printDuration("Async execution time naive: ", [&](){
             return async(are_primes, aVector).get();
     });
-    cout << "Async execution time naive:" << naiveAsyncDuration.count() << " ns" << endl;
 };
 
 auto runAsync = [](auto aVector){
@@ -104,8 +109,7 @@ auto runAsync = [](auto aVector){
 };
 
 auto measureRunAsync = [](auto aVector){
-    auto asyncDuration = measureExecutionTimeForF(bind(runAsync, aVector));
-    cout << "is prime async execution time:" << asyncDuration.count() << " ns" << endl;
+    printDuration("is prime async execution time: ", bind(runAsync, aVector));
 };
 
 
@@ -134,6 +138,7 @@ auto futureWithPromise = [](){
 };
 
 TEST_CASE("Future with promise"){
+    telemetry::Region region("Future with promise");
     futureWithPromise();
 }
 
@@ -161,13 +166,11 @@ TEST_CASE("Naive async duration"){
         return transformAll<vector<long>>(aVector, factorial);
     };
 
-    auto naiveAsyncDuration = measureExecutionTimeForF(
+    printDuration("Async execution time naive: ",
       [&](){
           future<vector<long>> result(async(all_factorials, aVector));
           return result.get();
       });
-
-      cout << "Async execution time naive:" << naiveAsyncDuration.count() << " ns" << endl;
 }
 
 TEST_CASE("more futures"){
@@ -187,6 +190,7 @@ TEST_CASE("more futures with loops"){
     vector<bool> expectedResults{true, false, false, true};
 
     vector<future<bool>> futures;
+    telemetry::Region region("more futures with loops");
     for(auto value : values){
         futures.push_back(async(is_prime, value));
     }
@@ -214,3 +218,231 @@ TEST_CASE("more futures functional"){
 
     CHECK_EQ(results, expectedResults);
 }
+
+TEST_CASE("submit to thread pool"){
+    ThreadPool pool(4);
+
+    auto futureIsPrime = pool.submit([](){ return is_prime(7757); });
+    auto futureFactorial = pool.submit([](){ return factorial(10); });
+    auto failing = pool.submit([]() -> int{ throw runtime_error("failed"); });
+
+    CHECK(futureIsPrime.get());
+    CHECK_EQ(3628800, futureFactorial.get());
+    CHECK_THROWS_AS(failing.get(), runtime_error);
+}
+
+TEST_CASE("thread pool tasks can wait for nested tasks"){
+    ThreadPool pool(2);
+
+    auto outer = pool.submit([&pool](){
+        vector<PoolFuture<bool>> inner;
+        for(int value : {2, 27, 1977, 7757}) inner.push_back(pool.submit([value](){ return is_prime(value); }));
+        vector<bool> results;
+        for(auto& result : inner) results.push_back(result.get());
+        return results;
+    });
+
+    vector<bool> expectedResults{true, false, false, true};
+    CHECK_EQ(expectedResults, outer.get());
+}
+
+TEST_CASE("are primes on thread pool"){
+    telemetry::Region region("are primes on thread pool");
+    ThreadPool pool(4);
+    vector<int> values(10000);
+    iota(values.begin(), values.end(), 2);
+
+    CHECK_EQ(are_primes(values), are_primes_on_pool(pool, values));
+}
+
+TEST_CASE("parallel transform on thread pool"){
+    ThreadPool pool(4);
+    vector<int> values(640);
+    iota(values.begin(), values.end(), 2);
+
+    SUBCASE("any grain keeps vector<bool> chunks apart"){
+        for(size_t grain : {1, 10, 63, 100}){
+            CHECK_EQ(are_primes(values), parallelTransformAll<vector<bool>>(pool, values, is_prime, grain));
+        }
+    }
+
+    SUBCASE("a failing chunk is rethrown once every chunk is done"){
+        atomic<size_t> transformed{0};
+        auto failOnFirst = [&transformed](const int value){
+            if(value == 2) throw runtime_error("failed");
+            this_thread::sleep_for(microseconds(10));
+            ++transformed;
+            return value;
+        };
+        CHECK_THROWS_AS(parallelTransformAll<vector<int>>(pool, values, failOnFirst, 64), runtime_error);
+        CHECK_EQ(values.size() - 64, transformed.load());
+    }
+}
+
+TEST_CASE("thread pool vs naive async benchmark" * doctest::skip()){
+    ThreadPool pool;
+    BenchmarkOptions options;
+    options.warmupRuns = 1;
+    options.samples = 5;
+
+    auto naiveAsync = [](const vector<int>& values){
+        vector<future<bool>> futures;
+        futures.reserve(values.size());
+        for(const int value : values) futures.push_back(async(launch::async, is_prime, value));
+        vector<bool> results;
+        results.reserve(values.size());
+        for(auto& aFuture : futures) results.push_back(aFuture.get());
+        return results;
+    };
+
+    for(const size_t size : {100000, 1000000, 10000000}){
+        vector<int> values(size);
+        for(size_t i = 0; i < size; ++i) values[i] = 2 + i % 1000;
+        const string label = to_string(size) + " values, ";
+
+        printBenchmark(runBenchmark(label + "sequential: ", [&](){ return are_primes(values); }, options));
+        printBenchmark(runBenchmark(label + "thread pool (" + to_string(pool.size()) + " workers): ", [&](){ return are_primes_on_pool(pool, values); }, options));
+        // One OS thread per value; past 10^5 values this only measures thread creation,
+        // and often the system refuses to create that many threads at all.
+        if(size <= 100000){
+            try{
+                printBenchmark(runBenchmark(label + "naive async: ", [&](){ return naiveAsync(values); }, options));
+            } catch(const system_error& error){
+                cout << label << "naive async: failed, " << error.what() << endl;
+            }
+        }
+
+        CHECK_EQ(are_primes(values), are_primes_on_pool(pool, values));
+    }
+}
+
+TEST_CASE("prime engine agrees with trial division"){
+    for(int value = 2; value < 3000; ++value){
+        CHECK_EQ(is_prime_trial_division(value), is_prime(value));
+    }
+    CHECK(!is_prime(0));
+    CHECK(!is_prime(1));
+    CHECK(!is_prime(-7));
+}
+
+TEST_CASE("Miller-Rabin agrees with wheel division"){
+    for(uint64_t value = 0; value < 100000; ++value){
+        CHECK_EQ(isPrimeWheel(value), isPrimeMillerRabin(value));
+    }
+    CHECK(isPrimeMillerRabin(61));
+}
+
+TEST_CASE("Miller-Rabin on large values"){
+    CHECK(isPrimeMillerRabin(2147483647ULL));
+    CHECK(isPrimeMillerRabin(1000000007ULL));
+    CHECK(!isPrimeMillerRabin(4759123141ULL));
+    CHECK(!isPrimeMillerRabin(3215031751ULL));
+    CHECK(isPrimeMillerRabin(18446744073709551557ULL));
+    CHECK(!isPrimeMillerRabin(18446744073709551555ULL));
+    CHECK(!isPrimeMillerRabin(3825123056546413051ULL));
+    CHECK_EQ(isPrimeWheel(1000003), isPrimeMillerRabin(1000003));
+    CHECK_EQ(isPrimeWheel(999999999989ULL), isPrimeMillerRabin(999999999989ULL));
+}
+
+TEST_CASE("segmented sieve"){
+    auto sieved = sieveRange(0, 200000, 4096);
+    for(int value = 0; value <= 200000; ++value){
+        if(sieved[value] != isPrimeWheel(value)) FAIL("sieve disagrees at " << value);
+    }
+
+    auto window = sieveRange(1000000000, 1000001000);
+    for(int offset = 0; offset <= 1000; ++offset){
+        CHECK_EQ(isPrimeMillerRabin(1000000000 + offset), window[offset]);
+    }
+
+    vector<int> dense(10000);
+    iota(dense.begin(), dense.end(), -5);
+    CHECK_EQ(are_primes(dense), arePrimes(dense));
+    vector<int> sparse{2, 27, 1977, 7757, 2147483647, 1000000007};
+    CHECK_EQ(vector<bool>{true, false, false, true, true, true}, arePrimes(sparse));
+}
+
+TEST_CASE("prime engine vs trial division"){
+    BenchmarkOptions options;
+    options.warmupRuns = 1;
+    options.samples = 5;
+    vector<int> values = rangeFromTo(2, 5000);
+
+    printBenchmark(runBenchmark("is_prime by trial division over 2..5000: ", [&](){ return transformAll<vector<bool>>(values, is_prime_trial_division); }, options));
+    printBenchmark(runBenchmark("is_prime with wheel/Miller-Rabin over 2..5000: ", [&](){ return are_primes(values); }, options));
+    printBenchmark(runBenchmark("segmented sieve over 2..5000: ", [&](){ return arePrimes(values); }, options));
+
+    vector<int> large = rangeFromTo(2000000000, 2000100000);
+    printBenchmark(runBenchmark("is_prime with Miller-Rabin over 10^5 values near 2*10^9: ", [&](){ return are_primes(large); }, options));
+    printBenchmark(runBenchmark("segmented sieve over 10^5 values near 2*10^9: ", [&](){ return arePrimes(large); }, options));
+    CHECK_EQ(are_primes(large), arePrimes(large));
+}
+
+TEST_CASE("telemetry regions"){
+    const size_t regionsBefore = telemetry::trace.snapshot().size();
+    {
+        telemetry::Region outer("outer");
+        vector<long long> numbers(1000);
+        {
+            telemetry::Region inner("inner");
+            auto buffer = make_unique<char[]>(1 << 20);
+            thread sleeper([](){ this_thread::sleep_for(milliseconds(20)); });
+            sleeper.join();
+        }
+    }
+
+    const auto regions = telemetry::trace.snapshot();
+    REQUIRE_EQ(regionsBefore + 2, regions.size());
+    const auto& inner = regions[regionsBefore];
+    const auto& outer = regions[regionsBefore + 1];
+
+    CHECK_EQ("inner", inner.name);
+    CHECK_EQ(1, inner.depth);
+    CHECK_GE(inner.allocations, 2);
+    CHECK_GE(inner.bytesAllocated, 1 << 20);
+    CHECK_EQ(inner.allocations, inner.deallocations);
+    CHECK_GE(inner.peakLiveBytes - inner.liveBytesStart, 1 << 20);
+    CHECK_GE(inner.peakThreads, inner.threadsStart + 1);
+    CHECK_EQ(inner.threadsStart, inner.threadsEnd);
+    CHECK_GT(inner.samples, 0);
+
+    CHECK_EQ("outer", outer.name);
+    CHECK_EQ(0, outer.depth);
+    CHECK_GE(outer.bytesAllocated, 8000 + (1 << 20));
+    CHECK_GE(outer.peakLiveBytes, inner.peakLiveBytes);
+    CHECK_GE(outer.duration, inner.duration);
+}
+
+TEST_CASE("telemetry regions open on several threads"){
+    optional<telemetry::Region> first;
+    first.emplace("first \"quoted\"");
+    {
+        auto buffer = make_unique<char[]>(4 << 20);
+        buffer[0] = 1;
+    }
+
+    // The second region opens and closes while the first is open on another thread.
+    promise<void> secondOpen;
+    promise<void> firstClosed;
+    thread other([&](){
+        telemetry::Region second("second");
+        secondOpen.set_value();
+        firstClosed.get_future().wait();
+    });
+    secondOpen.get_future().wait();
+    first.reset();
+    firstClosed.set_value();
+    other.join();
+
+    const auto regions = telemetry::trace.snapshot();
+    const auto firstRecord = find_if(regions.begin(), regions.end(), [](const auto& region){ return region.name == "first \"quoted\""; });
+    REQUIRE(firstRecord != regions.end());
+    CHECK_GE(firstRecord->peakLiveBytes - firstRecord->liveBytesStart, 4 << 20);
+
+    const string path = (filesystem::temp_directory_path() / ("telemetry." + to_string(getpid()) + ".json")).string();
+    REQUIRE(telemetry::trace.write(path));
+    ifstream file(path);
+    const string json((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    CHECK_NE(string::npos, json.find("\"name\":\"first \\\"quoted\\\"\""));
+    filesystem::remove(path);
+}
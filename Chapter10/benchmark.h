@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+// Keeps the compiler from discarding a value, or the computation producing it.
+template<typename T>
+inline void doNotOptimize(const T& value){
+    if constexpr(is_trivially_copyable<T>::value && sizeof(T) <= sizeof(void*)){
+        asm volatile("" : : "r,m"(value) : "memory");
+    } else {
+        asm volatile("" : : "m"(value) : "memory");
+    }
+}
+
+// Forces pending writes to memory to be considered observable.
+inline void clobberMemory(){
+    asm volatile("" : : : "memory");
+}
+
+template<typename F>
+inline void runAndKeep(F& f){
+    if constexpr(is_void<invoke_result_t<F&>>::value){
+        f();
+        clobberMemory();
+    } else {
+        auto result = f();
+        doNotOptimize(result);
+    }
+}
+
+// Single timed run. Only meaningful for effects that happen once, like the
+// first call to a memoized function; use runBenchmark for everything else.
+auto measureExecutionTimeForF = [](auto f){
+    auto t1 = steady_clock::now();
+    runAndKeep(f);
+    auto t2 = steady_clock::now();
+    chrono::nanoseconds duration = t2 - t1;
+    return duration;
+};
+
+struct BenchmarkOptions{
+    int warmupRuns = 3;
+    int samples = 31;
+    bool perfCounters = getenv("BENCHMARK_PERF") != nullptr;
+};
+
+struct PerfCounterValues{
+    bool available = false;
+    double cycles = 0;
+    double instructions = 0;
+    double cacheMisses = 0;
+};
+
+struct BenchmarkResult{
+    string name;
+    vector<long long> samples;
+    double mean = 0;
+    double median = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double confidenceLow = 0;
+    double confidenceHigh = 0;
+    PerfCounterValues counters;
+};
+
+// Hardware counters for the calling thread, read as one perf_event_open group.
+// Unavailable counters (no PMU, restricted perf_event_paranoid, containers)
+// leave the measurement running without them.
+class PerfCounters{
+    private:
+        int leader = -1;
+        vector<int> descriptors;
+
+        int openCounter(const uint64_t config, const int groupFd){
+            perf_event_attr attributes;
+            memset(&attributes, 0, sizeof(attributes));
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.size = sizeof(attributes);
+            attributes.config = config;
+            attributes.disabled = (groupFd == -1) ? 1 : 0;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_GROUP;
+            return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, groupFd, 0));
+        }
+
+    public:
+        PerfCounters(){
+            leader = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+            if(leader < 0) return;
+            descriptors.push_back(leader);
+            for(auto config : {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES}){
+                const int descriptor = openCounter(config, leader);
+                if(descriptor < 0){
+                    for(int opened : descriptors) close(opened);
+                    descriptors.clear();
+                    leader = -1;
+                    return;
+                }
+                descriptors.push_back(descriptor);
+            }
+        }
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        ~PerfCounters(){
+            for(int descriptor : descriptors) close(descriptor);
+        }
+
+        bool available() const{
+            return leader >= 0;
+        }
+
+        void start(){
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        PerfCounterValues stop(){
+            ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            uint64_t values[4] = {0, 0, 0, 0};
+            PerfCounterValues result;
+            if(read(leader, values, sizeof(values)) < static_cast<ssize_t>(sizeof(values))) return result;
+            result.available = true;
+            result.cycles = values[1];
+            result.instructions = values[2];
+            result.cacheMisses = values[3];
+            return result;
+        }
+};
+
+inline double percentileOf(const vector<long long>& sorted, const double percentile){
+    const size_t rank = static_cast<size_t>(ceil(percentile / 100.0 * sorted.size()));
+    return sorted[min(sorted.size(), max<size_t>(rank, 1)) - 1];
+}
+
+inline void summarize(BenchmarkResult& result){
+    vector<long long> sorted(result.samples);
+    sort(sorted.begin(), sorted.end());
+    const size_t count = sorted.size();
+
+    double sum = 0;
+    for(auto sample : sorted) sum += sample;
+    result.mean = sum / count;
+    result.median = (count % 2 == 1) ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0;
+    result.p95 = percentileOf(sorted, 95);
+    result.p99 = percentileOf(sorted, 99);
+
+    // Distribution free 95% confidence interval of the median, from the
+    // binomial order statistics n/2 -+ 1.96 * sqrt(n) / 2.
+    const double halfWidth = 0.98 * sqrt(static_cast<double>(count));
+    const long long lowRank = static_cast<long long>(floor(count / 2.0 - halfWidth));
+    const long long highRank = static_cast<long long>(ceil(count / 2.0 + halfWidth));
+    result.confidenceLow = sorted[max(0LL, lowRank)];
+    result.confidenceHigh = sorted[min(static_cast<long long>(count) - 1, highRank)];
+}
+
+template<typename F>
+BenchmarkResult runBenchmark(const string& name, F f, const BenchmarkOptions options = BenchmarkOptions()){
+    for(int run = 0; run < options.warmupRuns; ++run) runAndKeep(f);
+
+    BenchmarkResult result;
+    result.name = name;
+    result.samples.reserve(max(options.samples, 1));
+
+    // Only opened when asked for: each PerfCounters holds three descriptors.
+    optional<PerfCounters> perfCounters;
+    PerfCounters* counters = nullptr;
+    if(options.perfCounters){
+        perfCounters.emplace();
+        if(perfCounters->available()){
+            counters = &*perfCounters;
+            counters->start();
+        }
+    }
+
+    for(int sample = 0; sample < max(options.samples, 1); ++sample){
+        auto t1 = steady_clock::now();
+        runAndKeep(f);
+        auto t2 = steady_clock::now();
+        result.samples.push_back(duration_cast<nanoseconds>(t2 - t1).count());
+    }
+
+    if(counters != nullptr){
+        result.counters = counters->stop();
+        result.counters.cycles /= result.samples.size();
+        result.counters.instructions /= result.samples.size();
+        result.counters.cacheMisses /= result.samples.size();
+    }
+
+    summarize(result);
+    return result;
+}
+
+inline string escapeJson(const string& text){
+    string escaped;
+    for(char character : text){
+        switch(character){
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if(static_cast<unsigned char>(character) < 0x20){
+                    char code[7];
+                    snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(character));
+                    escaped += code;
+                } else {
+                    escaped += character;
+                }
+        }
+    }
+    return escaped;
+}
+
+// Messages passed to printDuration end with ": "; reports keep just the name.
+inline string reportName(const BenchmarkResult& result){
+    const auto end = result.name.find_last_not_of(": ");
+    return (end == string::npos) ? result.name : result.name.substr(0, end + 1);
+}
+
+inline string toJson(const BenchmarkResult& result){
+    ostringstream json;
+    json << "{\"name\":\"" << escapeJson(reportName(result)) << "\""
+        << ",\"samples\":" << result.samples.size()
+        << ",\"mean_ns\":" << result.mean
+        << ",\"median_ns\":" << result.median
+        << ",\"p95_ns\":" << result.p95
+        << ",\"p99_ns\":" << result.p99
+        << ",\"ci95_low_ns\":" << result.confidenceLow
+        << ",\"ci95_high_ns\":" << result.confidenceHigh;
+    if(result.counters.available){
+        json << ",\"cycles\":" << result.counters.cycles
+            << ",\"instructions\":" << result.counters.instructions
+            << ",\"cache_misses\":" << result.counters.cacheMisses;
+    }
+    json << "}";
+    return json.str();
+}
+
+inline string csvHeader(){
+    return "name,samples,mean_ns,median_ns,p95_ns,p99_ns,ci95_low_ns,ci95_high_ns,cycles,instructions,cache_misses";
+}
+
+inline string toCsv(const BenchmarkResult& result){
+    ostringstream csv;
+    string name = reportName(result);
+    replace(name.begin(), name.end(), '"', '\'');
+    csv << "\"" << name << "\"," << result.samples.size() << "," << result.mean << "," << result.median << ","
+        << result.p95 << "," << result.p99 << "," << result.confidenceLow << "," << result.confidenceHigh << ",";
+    if(result.counters.available){
+        csv << result.counters.cycles << "," << result.counters.instructions << "," << result.counters.cacheMisses;
+    } else {
+        csv << ",,";
+    }
+    return csv.str();
+}
+
+// Prints a one line summary, and appends the result to the files named by
+// BENCHMARK_JSON (JSON lines) and BENCHMARK_CSV when they are set.
+inline void printBenchmark(const BenchmarkResult& result){
+    const auto flags = cout.flags();
+    const auto precision = cout.precision();
+    cout << fixed << setprecision(0);
+    cout << result.name << "median " << result.median << " ns (p95 " << result.p95 << " ns, p99 " << result.p99
+        << " ns, 95% CI [" << result.confidenceLow << ", " << result.confidenceHigh << "] ns, " << result.samples.size() << " samples)";
+    if(result.counters.available){
+        cout << ", " << result.counters.cycles << " cycles, " << result.counters.instructions << " instructions, "
+            << result.counters.cacheMisses << " cache misses";
+    }
+    cout << endl;
+    cout.flags(flags);
+    cout.precision(precision);
+
+    if(const char* jsonPath = getenv("BENCHMARK_JSON")){
+        ofstream(jsonPath, ios::app) << toJson(result) << "\n";
+    }
+    if(const char* csvPath = getenv("BENCHMARK_CSV")){
+        const bool isEmpty = !ifstream(csvPath).good() || ifstream(csvPath).peek() == ifstream::traits_type::eof();
+        ofstream csv(csvPath, ios::app);
+        if(isEmpty) csv << csvHeader() << "\n";
+        csv << toCsv(result) << "\n";
+    }
+}
+
+auto printDuration = [](string message, auto f){
+    printBenchmark(runBenchmark(message, f));
+};
+
+auto printColdDuration = [](string message, auto f){
+    auto duration = measureExecutionTimeForF(f);
+    cout << message << duration.count() << " ns (single cold run)" << endl;
+};
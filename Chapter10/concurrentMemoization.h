@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include "memoizationCache.h"
+
+using namespace std;
+
+// Unbounded memoization cache for pure functions shared by many threads.
+// Buckets are singly linked lists that only ever grow at the head, so readers
+// walk them with acquire loads and never take a lock. Nodes are published
+// before their value is computed: the thread that wins the insertion computes,
+// every other thread asking for the same arguments waits on the node's future.
+// The bucket array is never resized, since moving nodes would break the lock
+// free readers: size it for the number of distinct arguments expected. With n
+// entries a lookup walks chains of about n / bucketCount nodes.
+template<typename ReturnType, typename... Args>
+class ConcurrentMemoizationCache{
+    private:
+        typedef tuple<Args...> Key;
+
+        struct Node{
+            const Key key;
+            const size_t hash;
+            Node* next;
+            atomic<bool> ready;
+            optional<ReturnType> value;
+            exception_ptr error;
+            promise<void> computed;
+            shared_future<void> whenComputed;
+
+            Node(const Key& key, const size_t hash) : key(key), hash(hash), next(nullptr), ready(false), whenComputed(computed.get_future()){};
+        };
+
+        const size_t mask;
+        unique_ptr<atomic<Node*>[]> buckets;
+        atomic<size_t> computations;
+        atomic<size_t> waits;
+
+        static Node* find(Node* node, const Node* stop, const Key& key, const size_t hash){
+            for(; node != stop; node = node->next){
+                if(node->hash == hash && node->key == key) return node;
+            }
+            return nullptr;
+        }
+
+        ReturnType resultOf(Node* node){
+            if(!node->ready.load(memory_order_acquire)){
+                waits.fetch_add(1, memory_order_relaxed);
+                node->whenComputed.wait();
+            }
+            if(node->error) rethrow_exception(node->error);
+            return *node->value;
+        }
+
+        static size_t roundUpToPowerOfTwo(const size_t value){
+            size_t result = 1;
+            while(result < value) result *= 2;
+            return result;
+        }
+
+    public:
+        explicit ConcurrentMemoizationCache(const size_t bucketCount = 4096) :
+            mask(roundUpToPowerOfTwo(bucketCount) - 1),
+            buckets(new atomic<Node*>[mask + 1]),
+            computations(0),
+            waits(0){
+            for(size_t i = 0; i <= mask; ++i) buckets[i].store(nullptr, memory_order_relaxed);
+        };
+
+        ConcurrentMemoizationCache(const ConcurrentMemoizationCache&) = delete;
+        ConcurrentMemoizationCache& operator=(const ConcurrentMemoizationCache&) = delete;
+
+        ~ConcurrentMemoizationCache(){
+            for(size_t i = 0; i <= mask; ++i){
+                Node* node = buckets[i].load(memory_order_relaxed);
+                while(node != nullptr){
+                    Node* next = node->next;
+                    delete node;
+                    node = next;
+                }
+            }
+        }
+
+        template<typename F>
+        ReturnType getOrCompute(const Key& key, F compute){
+            const size_t hash = hashTuple(key);
+            atomic<Node*>& bucket = buckets[hash & mask];
+
+            Node* head = bucket.load(memory_order_acquire);
+            Node* existing = find(head, nullptr, key, hash);
+            if(existing != nullptr) return resultOf(existing);
+
+            Node* candidate = new Node(key, hash);
+            candidate->next = head;
+            while(!bucket.compare_exchange_weak(candidate->next, candidate, memory_order_acq_rel, memory_order_acquire)){
+                // Only the nodes pushed since our last look can hold the same key.
+                existing = find(candidate->next, head, key, hash);
+                if(existing != nullptr){
+                    delete candidate;
+                    return resultOf(existing);
+                }
+                head = candidate->next;
+            }
+
+            computations.fetch_add(1, memory_order_relaxed);
+            try{
+                candidate->value.emplace(compute());
+            } catch(...){
+                candidate->error = current_exception();
+            }
+            candidate->ready.store(true, memory_order_release);
+            candidate->computed.set_value();
+            return resultOf(candidate);
+        }
+
+        size_t computationCount() const{
+            return computations.load(memory_order_relaxed);
+        }
+
+        size_t waitCount() const{
+            return waits.load(memory_order_relaxed);
+        }
+
+        size_t bucketCount() const{
+            return mask + 1;
+        }
+};
+
+template<typename ReturnType, typename... Args>
+function<ReturnType(Args...)> memoizeConcurrent(function<ReturnType(Args...)> f, shared_ptr<ConcurrentMemoizationCache<ReturnType, Args...>> cache){
+    return [f, cache](Args... args){
+        return cache->getOrCompute(tuple<Args...>(args...), [&](){ return f(args...); });
+    };
+};
+
+template<typename ReturnType, typename... Args>
+function<ReturnType(Args...)> memoizeConcurrent(function<ReturnType(Args...)> f, const size_t bucketCount = 4096){
+    return memoizeConcurrent(f, make_shared<ConcurrentMemoizationCache<ReturnType, Args...>>(bucketCount));
+};
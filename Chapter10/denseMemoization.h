@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "memoizeFix.h"
+
+using namespace std;
+
+// Inclusive range [Min, Max] of one integer argument.
+template<typename ValueType, ValueType Min, ValueType Max>
+struct ArgumentRange{
+    static_assert(is_integral<ValueType>::value, "dense memoization needs integer arguments");
+    static_assert(Min <= Max, "empty argument range");
+    typedef ValueType type;
+    static constexpr ValueType min = Min;
+    static constexpr ValueType max = Max;
+    static constexpr size_t size = static_cast<size_t>(Max - Min) + 1;
+};
+
+// Memo table for functions over small, bounded integer domains. In-range
+// arguments index a flat, cache line aligned array directly and a bitmap
+// records which cells hold a value. Arguments outside the declared ranges
+// go to a HashMemoTable. Nothing is allocated on the in-range path.
+template<typename ReturnType, typename... Ranges>
+class DenseMemoTable{
+    static_assert(is_default_constructible<ReturnType>::value, "dense memoization stores values in a flat array");
+
+    private:
+        static constexpr size_t cellCount = (Ranges::size * ...);
+        static constexpr size_t wordCount = (cellCount + 63) / 64;
+
+        alignas(64) array<ReturnType, cellCount> values;
+        alignas(64) array<uint64_t, wordCount> valid;
+        HashMemoTable<ReturnType, typename Ranges::type...> fallback;
+
+        // The offset from Range::min is only taken once the value is known to
+        // be in range, where it cannot overflow.
+        template<typename Range>
+        static bool addOffset(const typename Range::type value, size_t& cell){
+            if(value < Range::min || value > Range::max) return false;
+            cell = cell * Range::size + static_cast<size_t>(value - Range::min);
+            return true;
+        }
+
+        template<size_t... Indexes>
+        static bool cellFor(const tuple<typename Ranges::type...>& key, size_t& cell, index_sequence<Indexes...>){
+            cell = 0;
+            return (addOffset<Ranges>(get<Indexes>(key), cell) && ...);
+        }
+
+        static bool cellFor(const tuple<typename Ranges::type...>& key, size_t& cell){
+            return cellFor(key, cell, index_sequence_for<Ranges...>{});
+        }
+
+    public:
+        typedef ReturnType result_type;
+        typedef tuple<typename Ranges::type...> key_type;
+
+        DenseMemoTable() : values(), valid(){};
+
+        const ReturnType* lookup(const key_type& key) const{
+            size_t cell;
+            if(!cellFor(key, cell)) return fallback.lookup(key);
+            return (valid[cell / 64] >> (cell % 64) & 1) ? &values[cell] : nullptr;
+        }
+
+        void store(const key_type& key, const ReturnType& value){
+            size_t cell;
+            if(!cellFor(key, cell)){
+                fallback.store(key, value);
+                return;
+            }
+            values[cell] = value;
+            valid[cell / 64] |= uint64_t(1) << (cell % 64);
+        }
+};
+
+template<typename ReturnType, typename... Ranges>
+function<ReturnType(typename Ranges::type...)> memoizeDense(function<ReturnType(typename Ranges::type...)> f){
+    auto table = make_shared<DenseMemoTable<ReturnType, Ranges...>>();
+    return [f, table](typename Ranges::type... args){
+        const tuple<typename Ranges::type...> key(args...);
+        if(const ReturnType* cached = table->lookup(key)) return *cached;
+        ReturnType result = f(args...);
+        table->store(key, result);
+        return result;
+    };
+};
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "denseMemoization.h"
+#include "threadPool.h"
+
+using namespace std;
+
+// Maps the arguments of a function over integer ranges to a flat cell index,
+// row major, and back.
+template<typename... Ranges>
+struct TableIndex{
+    static constexpr size_t cellCount = (Ranges::size * ...);
+
+    static constexpr bool inRange(const typename Ranges::type... args){
+        return ((args >= Ranges::min && args <= Ranges::max) && ...);
+    }
+
+    static constexpr size_t cellFor(const typename Ranges::type... args){
+        size_t cell = 0;
+        ((cell = cell * Ranges::size + static_cast<size_t>(args - Ranges::min)), ...);
+        return cell;
+    }
+
+    static constexpr tuple<typename Ranges::type...> argumentsFor(size_t cell){
+        tuple<typename Ranges::type...> arguments{};
+        argumentsFor(cell, arguments, index_sequence_for<Ranges...>());
+        return arguments;
+    }
+
+    private:
+        // The last range varies fastest, so digits are peeled off from the back.
+        template<size_t... Indexes>
+        static constexpr void argumentsFor(size_t cell, tuple<typename Ranges::type...>& arguments, index_sequence<Indexes...>){
+            constexpr size_t last = sizeof...(Ranges) - 1;
+            ((get<last - Indexes>(arguments) = static_cast<typename tuple_element<last - Indexes, tuple<Ranges...>>::type::type>(
+                tuple_element<last - Indexes, tuple<Ranges...>>::type::min + cell % tuple_element<last - Indexes, tuple<Ranges...>>::type::size),
+              cell /= tuple_element<last - Indexes, tuple<Ranges...>>::type::size), ...);
+        }
+};
+
+// Every value of a pure function over small integer ranges, computed at compile
+// time when the table is declared constexpr. Lookups are a single array index.
+template<typename ReturnType, typename... Ranges>
+class ConstexprFunctionTable{
+    private:
+        typedef TableIndex<Ranges...> Index;
+        array<ReturnType, Index::cellCount> values{};
+
+    public:
+        template<typename F>
+        constexpr explicit ConstexprFunctionTable(F f){
+            for(size_t cell = 0; cell < Index::cellCount; ++cell) values[cell] = apply(f, Index::argumentsFor(cell));
+        }
+
+        constexpr const ReturnType& operator()(const typename Ranges::type... args) const{
+            return values[Index::cellFor(args...)];
+        }
+
+        constexpr const ReturnType& at(const typename Ranges::type... args) const{
+            if(!Index::inRange(args...)) throw out_of_range("argument outside of the table");
+            return values[Index::cellFor(args...)];
+        }
+};
+
+template<typename ReturnType, typename... Ranges, typename F>
+constexpr ConstexprFunctionTable<ReturnType, Ranges...> makeConstexprTable(F f){
+    return ConstexprFunctionTable<ReturnType, Ranges...>(f);
+}
+
+// The same table computed at startup, for functions that are not constexpr or
+// domains too large to compute in the compiler. Cells are independent, so the
+// parallel constructor splits them over a thread pool.
+template<typename ReturnType, typename... Ranges>
+class FunctionTable{
+    private:
+        typedef TableIndex<Ranges...> Index;
+        vector<ReturnType> values;
+
+        template<typename F>
+        static auto valueOf(F& f){
+            return [&f](const size_t cell){ return apply(f, Index::argumentsFor(cell)); };
+        }
+
+    public:
+        template<typename F>
+        explicit FunctionTable(F f) : values(Index::cellCount){
+            for(size_t cell = 0; cell < Index::cellCount; ++cell) values[cell] = valueOf(f)(cell);
+        }
+
+        template<typename F>
+        FunctionTable(ThreadPool& pool, F f){
+            vector<size_t> cells(Index::cellCount);
+            iota(cells.begin(), cells.end(), 0);
+            values = parallelTransformAll<vector<ReturnType>>(pool, cells, valueOf(f));
+        }
+
+        const ReturnType& operator()(const typename Ranges::type... args) const{
+            return values[Index::cellFor(args...)];
+        }
+
+        const ReturnType& at(const typename Ranges::type... args) const{
+            if(!Index::inRange(args...)) throw out_of_range("argument outside of the table");
+            return values[Index::cellFor(args...)];
+        }
+};
+
+constexpr uint64_t factorialByLoop(const int n){
+    uint64_t result = 1;
+    for(int value = 2; value <= n; ++value) result *= value;
+    return result;
+}
+
+// 20! is the largest factorial that fits in 64 bits.
+constexpr auto factorialTable = makeConstexprTable<uint64_t, ArgumentRange<int, 0, 20>>(factorialByLoop);
+
+// Throws out_of_range instead of overflowing past 20!.
+constexpr uint64_t factorial64(const int n){
+    return factorialTable.at(n);
+}
+
+// Arbitrary precision unsigned integer: little endian 32 bit limbs, no leading
+// zero limbs. Multiplication switches from schoolbook to Karatsuba once both
+// factors are long enough for the saved sub-products to pay for the additions.
+class BigUnsigned{
+    private:
+        vector<uint32_t> limbs;
+
+        typedef vector<uint32_t> Limbs;
+
+        static void trim(Limbs& value){
+            while(!value.empty() && value.back() == 0) value.pop_back();
+        }
+
+        static Limbs add(const Limbs& first, const Limbs& second){
+            const Limbs& longer = (first.size() >= second.size()) ? first : second;
+            const Limbs& shorter = (first.size() >= second.size()) ? second : first;
+            Limbs sum(longer.size() + 1);
+            uint64_t carry = 0;
+            for(size_t i = 0; i < longer.size(); ++i){
+                carry += uint64_t(longer[i]) + ((i < shorter.size()) ? shorter[i] : 0);
+                sum[i] = static_cast<uint32_t>(carry);
+                carry >>= 32;
+            }
+            sum[longer.size()] = static_cast<uint32_t>(carry);
+            trim(sum);
+            return sum;
+        }
+
+        // value -= subtrahend, where value >= subtrahend.
+        static void subtractInPlace(Limbs& value, const Limbs& subtrahend){
+            int64_t borrow = 0;
+            for(size_t i = 0; i < value.size(); ++i){
+                int64_t difference = int64_t(value[i]) - ((i < subtrahend.size()) ? subtrahend[i] : 0) - borrow;
+                borrow = (difference < 0) ? 1 : 0;
+                value[i] = static_cast<uint32_t>(difference + (borrow << 32));
+                if(i >= subtrahend.size() && borrow == 0) break;
+            }
+            trim(value);
+        }
+
+        // result += addend * 2^(32 * shift); result must be long enough.
+        static void addShifted(Limbs& result, const Limbs& addend, const size_t shift){
+            uint64_t carry = 0;
+            size_t i = 0;
+            for(; i < addend.size(); ++i){
+                carry += uint64_t(result[i + shift]) + addend[i];
+                result[i + shift] = static_cast<uint32_t>(carry);
+                carry >>= 32;
+            }
+            for(size_t position = i + shift; carry != 0; ++position){
+                carry += result[position];
+                result[position] = static_cast<uint32_t>(carry);
+                carry >>= 32;
+            }
+        }
+
+        static Limbs lowHalf(const Limbs& value, const size_t split){
+            Limbs low(value.begin(), value.begin() + min(split, value.size()));
+            trim(low);
+            return low;
+        }
+
+        static Limbs highHalf(const Limbs& value, const size_t split){
+            if(value.size() <= split) return {};
+            return Limbs(value.begin() + split, value.end());
+        }
+
+    public:
+        static const size_t karatsubaThreshold = 48;
+
+        BigUnsigned(uint64_t value = 0){
+            while(value != 0){
+                limbs.push_back(static_cast<uint32_t>(value));
+                value >>= 32;
+            }
+        }
+
+        static Limbs multiplySchoolbook(const Limbs& first, const Limbs& second){
+            if(first.empty() || second.empty()) return {};
+            Limbs product(first.size() + second.size(), 0);
+            for(size_t i = 0; i < first.size(); ++i){
+                uint64_t carry = 0;
+                for(size_t j = 0; j < second.size(); ++j){
+                    carry += uint64_t(first[i]) * second[j] + product[i + j];
+                    product[i + j] = static_cast<uint32_t>(carry);
+                    carry >>= 32;
+                }
+                product[i + second.size()] = static_cast<uint32_t>(carry);
+            }
+            trim(product);
+            return product;
+        }
+
+        // (a1 B + a0)(b1 B + b0) = a1 b1 B^2 + ((a0 + a1)(b0 + b1) - a0 b0 - a1 b1) B + a0 b0
+        static Limbs multiplyKaratsuba(const Limbs& first, const Limbs& second){
+            if(min(first.size(), second.size()) < karatsubaThreshold) return multiplySchoolbook(first, second);
+
+            const size_t split = max(first.size(), second.size()) / 2;
+            const Limbs firstLow = lowHalf(first, split);
+            const Limbs firstHigh = highHalf(first, split);
+            const Limbs secondLow = lowHalf(second, split);
+            const Limbs secondHigh = highHalf(second, split);
+
+            const Limbs low = multiplyKaratsuba(firstLow, secondLow);
+            const Limbs high = multiplyKaratsuba(firstHigh, secondHigh);
+            Limbs middle = multiplyKaratsuba(add(firstLow, firstHigh), add(secondLow, secondHigh));
+            subtractInPlace(middle, low);
+            subtractInPlace(middle, high);
+
+            Limbs product(first.size() + second.size() + 1, 0);
+            addShifted(product, low, 0);
+            addShifted(product, middle, split);
+            addShifted(product, high, 2 * split);
+            trim(product);
+            return product;
+        }
+
+        static BigUnsigned fromLimbs(Limbs value){
+            trim(value);
+            BigUnsigned result;
+            result.limbs = move(value);
+            return result;
+        }
+
+        const Limbs& asLimbs() const{
+            return limbs;
+        }
+
+        friend BigUnsigned operator*(const BigUnsigned& first, const BigUnsigned& second){
+            return fromLimbs(multiplyKaratsuba(first.limbs, second.limbs));
+        }
+
+        friend BigUnsigned operator+(const BigUnsigned& first, const BigUnsigned& second){
+            return fromLimbs(add(first.limbs, second.limbs));
+        }
+
+        friend bool operator==(const BigUnsigned& first, const BigUnsigned& second){
+            return first.limbs == second.limbs;
+        }
+
+        friend bool operator!=(const BigUnsigned& first, const BigUnsigned& second){
+            return !(first == second);
+        }
+
+        // Decimal digits by repeated division by 10^9, one limb at a time.
+        string toString() const{
+            if(limbs.empty()) return "0";
+            Limbs remaining(limbs);
+            vector<uint32_t> chunks;
+            while(!remaining.empty()){
+                uint64_t remainder = 0;
+                for(size_t i = remaining.size(); i-- > 0;){
+                    const uint64_t current = (remainder << 32) | remaining[i];
+                    remaining[i] = static_cast<uint32_t>(current / 1000000000);
+                    remainder = current % 1000000000;
+                }
+                trim(remaining);
+                chunks.push_back(static_cast<uint32_t>(remainder));
+            }
+            string digits = to_string(chunks.back());
+            for(size_t i = chunks.size() - 1; i-- > 0;){
+                const string chunk = to_string(chunks[i]);
+                digits.append(9 - chunk.size(), '0').append(chunk);
+            }
+            return digits;
+        }
+};
+
+// Product of low..high by splitting the range in halves, so the factors of
+// every multiplication have about the same length and Karatsuba gets to work
+// on big balanced operands instead of one huge number times a small one.
+inline BigUnsigned productTree(const uint64_t low, const uint64_t high){
+    if(high < low) return BigUnsigned(1);
+    if(high - low < 8){
+        BigUnsigned result(1);
+        uint64_t accumulated = 1;
+        for(uint64_t value = low; value <= high; ++value){
+            if(accumulated > UINT64_MAX / value){
+                result = result * BigUnsigned(accumulated);
+                accumulated = 1;
+            }
+            accumulated *= value;
+        }
+        return result * BigUnsigned(accumulated);
+    }
+    const uint64_t middle = low + (high - low) / 2;
+    return productTree(low, middle) * productTree(middle + 1, high);
+}
+
+inline BigUnsigned factorialBig(const uint64_t n){
+    return productTree(2, n);
+}
+
+// The ranges of the top levels of the product tree go to the pool; the partial
+// products are then multiplied pairwise, again in parallel.
+inline BigUnsigned factorialBig(const uint64_t n, ThreadPool& pool){
+    const uint64_t chunkCount = min<uint64_t>(max<uint64_t>(n / 64, 1), pool.size() * 4);
+    vector<PoolFuture<BigUnsigned>> chunks;
+    const uint64_t chunkLength = (n + chunkCount - 1) / chunkCount;
+    for(uint64_t low = 1; low <= n; low += chunkLength){
+        const uint64_t high = min(n, low + chunkLength - 1);
+        chunks.push_back(pool.submit([low, high](){ return productTree(max<uint64_t>(low, 2), high); }));
+    }
+    vector<BigUnsigned> partials;
+    for(auto& chunk : chunks) partials.push_back(chunk.get());
+
+    while(partials.size() > 1){
+        vector<PoolFuture<BigUnsigned>> products;
+        for(size_t i = 0; i + 1 < partials.size(); i += 2){
+            products.push_back(pool.submit([&partials, i](){ return partials[i] * partials[i + 1]; }));
+        }
+        vector<BigUnsigned> next;
+        for(auto& product : products) next.push_back(product.get());
+        if(partials.size() % 2 == 1) next.push_back(partials.back());
+        partials = move(next);
+    }
+    return partials.empty() ? BigUnsigned(1) : partials.front();
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "parallelAlgorithms.h"
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t hugePageSize = 2 * 1024 * 1024;
+
+enum class NumaPlacement{
+    // Pages land on the node of the thread that faults them first; with
+    // prefaulting that is the pool worker that later transforms the same chunk.
+    FirstTouch,
+    Interleave,
+    Node
+};
+
+struct HugePageOptions{
+    // MAP_HUGETLB needs pages reserved in /proc/sys/vm/nr_hugepages; without
+    // them the allocation falls back to transparent huge pages.
+    bool explicitHugePages = true;
+    bool transparentHugePages = true;
+    bool prefault = true;
+    NumaPlacement placement = NumaPlacement::FirstTouch;
+    int numaNode = 0;
+    // When the pages cannot be placed as asked, e.g. numaNode does not exist or
+    // mbind is not permitted, they are left to first touch; with strictPlacement
+    // the allocation throws instead.
+    bool strictPlacement = false;
+    // Smaller buffers go through operator new.
+    size_t minimumBytes = hugePageSize;
+    parallel::ParallelPolicy policy = parallel::par;
+};
+
+// Nodes listed in /sys/devices/system/node/online, e.g. "0-1"; 1 without NUMA.
+inline int numaNodeCount(){
+    ifstream online("/sys/devices/system/node/online");
+    string ranges;
+    if(!(online >> ranges)) return 1;
+    int last = 0;
+    size_t position = 0;
+    while(position < ranges.size()){
+        size_t end = ranges.find_first_of(",", position);
+        if(end == string::npos) end = ranges.size();
+        const string range = ranges.substr(position, end - position);
+        const size_t dash = range.find('-');
+        last = max(last, stoi((dash == string::npos) ? range : range.substr(dash + 1)));
+        position = end + 1;
+    }
+    return last + 1;
+}
+
+// mbind(2) through syscall, so there is no dependency on libnuma.
+inline bool bindToNumaNodes(void* address, const size_t bytes, const NumaPlacement placement, const int node){
+    const int interleave = 3;
+    const int bind = 2;
+    const int nodeCount = numaNodeCount();
+    if(placement == NumaPlacement::Node && (node < 0 || node >= nodeCount)){
+        errno = EINVAL;
+        return false;
+    }
+    if(placement == NumaPlacement::FirstTouch || nodeCount <= 1) return true;
+
+    vector<unsigned long> nodeMask((nodeCount + 63) / 64, 0);
+    if(placement == NumaPlacement::Interleave){
+        for(int i = 0; i < nodeCount; ++i) nodeMask[i / 64] |= 1UL << (i % 64);
+    } else {
+        nodeMask[node / 64] |= 1UL << (node % 64);
+    }
+    const int mode = (placement == NumaPlacement::Interleave) ? interleave : bind;
+    return syscall(SYS_mbind, address, bytes, mode, nodeMask.data(), nodeMask.size() * 64 + 1, 0) == 0;
+}
+
+// Touches one byte per page on the pool workers, so the page faults of a giant
+// buffer are taken in parallel instead of by the first loop that writes it.
+inline void prefaultPages(void* address, const size_t bytes, const size_t pageSize, const parallel::ParallelPolicy& policy){
+    volatile char* bytesToTouch = static_cast<volatile char*>(address);
+    const size_t pages = (bytes + pageSize - 1) / pageSize;
+    parallel::forEachChunk(policy, pages, [=](size_t begin, size_t end, size_t){
+        for(size_t page = begin; page < end; ++page) bytesToTouch[page * pageSize] = 0;
+    });
+}
+
+struct HugePageMapping{
+    void* address;
+    size_t bytes;
+    bool explicitHugePages;
+};
+
+inline HugePageMapping mapHugePages(const size_t requestedBytes, const HugePageOptions& options){
+    const size_t bytes = (requestedBytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    // No MAP_NORESERVE: the mapping must fail here when the pool of huge pages
+    // is short, not raise SIGBUS on first touch.
+    if(options.explicitHugePages){
+        void* address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if(address != MAP_FAILED) return {address, bytes, true};
+    }
+
+    // Over allocate by one huge page so the buffer can start on a huge page
+    // boundary, which transparent huge pages need to back its first bytes.
+    const size_t mappedBytes = bytes + hugePageSize;
+    void* mapped = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if(mapped == MAP_FAILED) throw bad_alloc();
+    const uintptr_t start = reinterpret_cast<uintptr_t>(mapped);
+    const uintptr_t aligned = (start + hugePageSize - 1) / hugePageSize * hugePageSize;
+    if(aligned > start) munmap(mapped, aligned - start);
+    const size_t tail = (start + mappedBytes) - (aligned + bytes);
+    if(tail > 0) munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+
+    void* address = reinterpret_cast<void*>(aligned);
+    if(options.transparentHugePages) madvise(address, bytes, MADV_HUGEPAGE);
+    return {address, bytes, false};
+}
+
+// Allocator for the destination containers of the transform helpers, e.g.
+// transformAll<vector<long long, HugePageAllocator<long long>>>. Large buffers are
+// mapped on huge pages, placed on NUMA nodes and prefaulted in parallel.
+template<typename T>
+class HugePageAllocator{
+    private:
+        static constexpr bool overAligned = alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    public:
+        typedef T value_type;
+
+        HugePageOptions options;
+
+        HugePageAllocator() = default;
+        explicit HugePageAllocator(const HugePageOptions& options) : options(options){};
+
+        template<typename U>
+        HugePageAllocator(const HugePageAllocator<U>& other) : options(other.options){};
+
+        T* allocate(const size_t count){
+            if(count > numeric_limits<size_t>::max() / sizeof(T)) throw bad_array_new_length();
+            const size_t bytes = count * sizeof(T);
+            if(bytes < options.minimumBytes){
+                if constexpr(overAligned) return static_cast<T*>(::operator new(bytes, align_val_t(alignof(T))));
+                else return static_cast<T*>(::operator new(bytes));
+            }
+
+            const HugePageMapping mapping = mapHugePages(bytes, options);
+            if(!bindToNumaNodes(mapping.address, mapping.bytes, options.placement, options.numaNode) && options.strictPlacement){
+                const int error = errno;
+                munmap(mapping.address, mapping.bytes);
+                throw system_error(error, generic_category(), "mbind");
+            }
+            if(options.prefault){
+                const size_t pageSize = mapping.explicitHugePages ? hugePageSize : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+                prefaultPages(mapping.address, mapping.bytes, pageSize, options.policy);
+            }
+            return static_cast<T*>(mapping.address);
+        }
+
+        // Which path a buffer took depends only on its size, so the decision is
+        // repeated here instead of being stored.
+        void deallocate(T* pointer, const size_t count) noexcept{
+            const size_t bytes = count * sizeof(T);
+            if(bytes < options.minimumBytes){
+                if constexpr(overAligned) ::operator delete(pointer, align_val_t(alignof(T)));
+                else ::operator delete(pointer);
+                return;
+            }
+            munmap(pointer, (bytes + hugePageSize - 1) / hugePageSize * hugePageSize);
+        }
+};
+
+// Any instance can free memory from any other with the same minimum size.
+template<typename T, typename U>
+bool operator==(const HugePageAllocator<T>& first, const HugePageAllocator<U>& second){
+    return first.options.minimumBytes == second.options.minimumBytes;
+}
+
+template<typename T, typename U>
+bool operator!=(const HugePageAllocator<T>& first, const HugePageAllocator<U>& second){
+    return !(first == second);
+}
+
+struct PageFaultMeasurement{
+    nanoseconds duration;
+    long minorFaults;
+    long majorFaults;
+};
+
+// Wall time and page faults of the whole process while f runs.
+template<typename F>
+PageFaultMeasurement measurePageFaults(F f){
+    rusage before;
+    rusage after;
+    getrusage(RUSAGE_SELF, &before);
+    const auto start = steady_clock::now();
+    f();
+    const auto end = steady_clock::now();
+    getrusage(RUSAGE_SELF, &after);
+    return {end - start, after.ru_minflt - before.ru_minflt, after.ru_majflt - before.ru_majflt};
+}
@@ -3,21 +3,25 @@
 #include <string>
 #include <functional>
 #include <numeric>
+#include <limits>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "benchmark.h"
+#include "memoizationCache.h"
+#include "concurrentMemoization.h"
+#include "memoizeFix.h"
+#include "denseMemoization.h"
+#include "persistentMemoization.h"
+#include "functionTables.h"
 
 using namespace std;
 using namespace std::placeholders;
 using namespace std::chrono;
 
-auto measureExecutionTimeForF = [](auto f){
-    auto t1 = high_resolution_clock::now();
-    f();
-    auto t2 = high_resolution_clock::now();
-    chrono::nanoseconds duration = t2 - t1;
-    return duration;
-};
-
 template<typename ReturnType, typename... Args>
 function<ReturnType(Args...)> memoize(function<ReturnType(Args...)> f){
     map<tuple<Args...>, ReturnType> cache;
@@ -31,11 +35,6 @@ function<ReturnType(Args...)> memoize(function<ReturnType(Args...)> f){
     });
 };
 
-auto printDuration = [](string message, auto f){
-    auto duration = measureExecutionTimeForF(f);
-    cout << message  << duration.count() << " ns" << endl;
-};
-
 template<typename ReturnType, typename FirstArgType, typename SecondArgType>
 auto memoizeTwoParams = [](function<ReturnType(FirstArgType, SecondArgType)> functionToMemoize){
     map<tuple<FirstArgType, SecondArgType>, ReturnType> cache;
@@ -94,9 +93,9 @@ TEST_CASE("Pow vs memoized pow"){
         return value;
     };
 
-    printDuration("First call with recursive memoization: ",  [&](){ return powerWithMemoization(5, 24);});
-    printDuration("Second call with recursive memoization: ", [&](){return powerWithMemoization(3, 1024);});
-    printDuration("Third call with recursive memoization: ", [&](){return powerWithMemoization(9, 176);});
+    printColdDuration("First call with recursive memoization: ",  [&](){ return powerWithMemoization(5, 24);});
+    printColdDuration("Second call with recursive memoization: ", [&](){return powerWithMemoization(3, 1024);});
+    printColdDuration("Third call with recursive memoization: ", [&](){return powerWithMemoization(9, 176);});
     printDuration("Fourth call with recursive memoization (same as first call): ", [&](){return powerWithMemoization(5, 24);});
     cout << "DONE computing pow" << endl;
 
@@ -105,6 +104,77 @@ TEST_CASE("Pow vs memoized pow"){
     CHECK_EQ(power(9, 176),  powerWithMemoization(9, 176));
 }
 
+TEST_CASE("Pow with concurrent memoization from 1 to N threads"){
+    function<long long(int, int)> power = [&](auto base, auto exponent){
+        return (exponent == 0) ? 1 : base * power(base, exponent - 1);
+    };
+
+    const int maxThreads = max(4, static_cast<int>(thread::hardware_concurrency()));
+    const int callsPerThread = 20000;
+    const int distinctArguments = 8 * 64;
+
+    cout << "Computing pow with concurrent memoization" << endl;
+    for(int threadCount = 1; threadCount <= maxThreads; threadCount *= 2){
+        auto cache = make_shared<ConcurrentMemoizationCache<long long, int, int>>(2 * distinctArguments);
+        auto powerWithMemoization = memoizeConcurrent(power, cache);
+        atomic<long long> checksum(0);
+
+        auto duration = measureExecutionTimeForF([&](){
+            vector<thread> threads;
+            for(int threadIndex = 0; threadIndex < threadCount; ++threadIndex){
+                threads.emplace_back([&](){
+                    long long localChecksum = 0;
+                    for(int call = 0; call < callsPerThread; ++call){
+                        localChecksum += powerWithMemoization(2 + call % 8, 100 + (call / 8) % 64);
+                    }
+                    checksum += localChecksum;
+                });
+            }
+            for(auto& aThread : threads) aThread.join();
+        });
+
+        const double callsPerSecond = threadCount * callsPerThread * 1e9 / duration.count();
+        cout << threadCount << " threads: " << duration.count() << " ns, " << static_cast<long long>(callsPerSecond) << " calls/s, " << cache->computationCount() << " computations" << endl;
+        CHECK_EQ(distinctArguments, cache->computationCount());
+        CHECK_EQ(1024, cache->bucketCount());
+    }
+    cout << "DONE computing pow with concurrent memoization" << endl;
+}
+
+TEST_CASE("Concurrent memoization computes in-flight arguments only once"){
+    atomic<int> invocations(0);
+    function<long long(int, int)> slowPower = [&](int base, int exponent) -> long long{
+        ++invocations;
+        this_thread::sleep_for(chrono::milliseconds(50));
+        return pow(base, exponent);
+    };
+    auto cache = make_shared<ConcurrentMemoizationCache<long long, int, int>>();
+    auto memoizedPower = memoizeConcurrent(slowPower, cache);
+
+    vector<future<long long>> results;
+    for(int i = 0; i < 8; ++i){
+        results.push_back(async(launch::async, [&](){ return memoizedPower(3, 19); }));
+    }
+    for(auto& result : results){
+        CHECK_EQ(1162261467, result.get());
+    }
+
+    CHECK_EQ(1, invocations.load());
+    CHECK_EQ(1, cache->computationCount());
+}
+
+TEST_CASE("Concurrent memoization rethrows the failure to every caller"){
+    function<int(int)> failing = [](int value) -> int{
+        if(value < 0) throw invalid_argument("negative");
+        return value;
+    };
+    auto memoizedFailing = memoizeConcurrent(failing);
+
+    CHECK_EQ(3, memoizedFailing(3));
+    CHECK_THROWS_AS(memoizedFailing(-1), invalid_argument);
+    CHECK_THROWS_AS(memoizedFailing(-1), invalid_argument);
+}
+
 TEST_CASE("Complex expression vs memoized"){
     function<int(int, int)> expression = [](auto first, auto second){
         return (first * (25^7)) + (39^second);
@@ -117,9 +187,9 @@ TEST_CASE("Complex expression vs memoized"){
     printDuration("Fourth call no memoization (same as first call): ", [&](){return expression(5, 24);});
 
     auto expressionWithMemoization = memoize(expression);
-    printDuration("First call with memoization: ",  [&](){ return expressionWithMemoization(5, 24);});
-    printDuration("Second call with memoization: ", [&](){return expressionWithMemoization(3, 1024);});
-    printDuration("Third call with memoization: ", [&](){return expressionWithMemoization(9, 176);});
+    printColdDuration("First call with memoization: ",  [&](){ return expressionWithMemoization(5, 24);});
+    printColdDuration("Second call with memoization: ", [&](){return expressionWithMemoization(3, 1024);});
+    printColdDuration("Third call with memoization: ", [&](){return expressionWithMemoization(9, 176);});
     printDuration("Fourth call with memoization (same as first call): ", [&](){return expressionWithMemoization(5, 24);});
     cout << "DONE computing expression" << endl;
 
@@ -148,15 +218,15 @@ TEST_CASE("Factorial difference vs memoized"){
     function<int(int, int)> factorialMemoizedDifference = [&factWithMemoization](auto first, auto second){
         return factWithMemoization(second) - factWithMemoization(first);
     };
-    printDuration("First call with memoized factorial: ",  [&](){ return factorialMemoizedDifference(5, 24);});
-    printDuration("Second call with memoized factorial: ", [&](){return factorialMemoizedDifference(3, 1024);});
-    printDuration("Third call with memoized factorial: ", [&](){return factorialMemoizedDifference(9, 176);});
+    printColdDuration("First call with memoized factorial: ",  [&](){ return factorialMemoizedDifference(5, 24);});
+    printColdDuration("Second call with memoized factorial: ", [&](){return factorialMemoizedDifference(3, 1024);});
+    printColdDuration("Third call with memoized factorial: ", [&](){return factorialMemoizedDifference(9, 176);});
     printDuration("Fourth call with memoized factorial (same as first call): ", [&](){return factorialMemoizedDifference(5, 24);});
  
     auto factorialDifferenceWithMemoization = memoize(factorialDifference);
-    printDuration("First call with memoization: ",  [&](){ return factorialDifferenceWithMemoization(5, 24);});
-    printDuration("Second call with memoization: ", [&](){return factorialDifferenceWithMemoization(3, 1024);});
-    printDuration("Third call with memoization: ", [&](){return factorialDifferenceWithMemoization(9, 176);});
+    printColdDuration("First call with memoization: ",  [&](){ return factorialDifferenceWithMemoization(5, 24);});
+    printColdDuration("Second call with memoization: ", [&](){return factorialDifferenceWithMemoization(3, 1024);});
+    printColdDuration("Third call with memoization: ", [&](){return factorialDifferenceWithMemoization(9, 176);});
     printDuration("Fourth call with memoization (same as first call): ", [&](){return factorialDifferenceWithMemoization(5, 24);});
 
     cout << "DONE computing factorial difference" << endl;
@@ -205,12 +275,457 @@ TEST_CASE("Factorial difference vs recursively memoized factorial"){
     printDuration("Third call no memoization: ", [&](){return factorialDifference(9, 176);});
     printDuration("Fourth call no memoization (same as first call): ", [&](){return factorialDifference(5, 24);});
 
-    printDuration("First call with recursive memoized factorial: ",  [&](){ return factorialMemoizedDifference(5, 24);});
-    printDuration("Second call with recursive memoized factorial: ", [&](){return factorialMemoizedDifference(3, 1024);});
-    printDuration("Third call with recursive memoized factorial: ", [&](){return factorialMemoizedDifference(9, 176);});
+    printColdDuration("First call with recursive memoized factorial: ",  [&](){ return factorialMemoizedDifference(5, 24);});
+    printColdDuration("Second call with recursive memoized factorial: ", [&](){return factorialMemoizedDifference(3, 1024);});
+    printColdDuration("Third call with recursive memoized factorial: ", [&](){return factorialMemoizedDifference(9, 176);});
     printDuration("Fourth call with recursive memoized factorial (same as first call): ", [&](){return factorialMemoizedDifference(5, 24);});
 
     CHECK_EQ(factorialDifference(5, 24),  factorialMemoizedDifference(5, 24));
     CHECK_EQ(factorialDifference(3, 1024),  factorialMemoizedDifference(3, 1024));
     CHECK_EQ(factorialDifference(9, 176),  factorialMemoizedDifference(9, 176));
 } 
+
+TEST_CASE("Pow with bounded hash cache"){
+    function<long long(int, int)> power = [](int base, int exponent) -> long long{
+        return pow(base, exponent);
+    };
+
+    auto cache = make_shared<MemoizationCache<long long, int, int>>(64);
+    auto memoizedPower = memoizeWithCache(power, cache);
+
+    CHECK_EQ(power(3, 19), memoizedPower(3, 19));
+    CHECK_EQ(power(3, 19), memoizedPower(3, 19));
+    CHECK_EQ(power(2, 25), memoizedPower(2, 25));
+
+    auto statistics = cache->statistics();
+    CHECK_EQ(1, statistics.hits);
+    CHECK_EQ(2, statistics.misses);
+    CHECK_EQ(2, statistics.size);
+}
+
+TEST_CASE("Bounded hash cache never grows past its capacity"){
+    function<int(int)> square = [](int value){ return value * value; };
+    auto cache = make_shared<MemoizationCache<int, int>>(100);
+    auto memoizedSquare = memoizeWithCache(square, cache);
+
+    for(int value = 0; value < 1000; ++value){
+        CHECK_EQ(value * value, memoizedSquare(value));
+    }
+
+    auto statistics = cache->statistics();
+    CHECK_EQ(100, statistics.size);
+    CHECK_EQ(100, statistics.capacity);
+    CHECK_EQ(1000, statistics.misses);
+    CHECK_EQ(1000 - statistics.size, statistics.evictions);
+}
+
+TEST_CASE("LRU evicts the least recently used arguments"){
+    MemoizationCache<int, int> cache(2, EvictionPolicy::LRU, 1);
+    auto identity = [](int value){ return [value](){ return value; }; };
+
+    cache.getOrCompute(make_tuple(1), identity(1));
+    cache.getOrCompute(make_tuple(2), identity(2));
+    cache.getOrCompute(make_tuple(1), identity(1));
+    cache.getOrCompute(make_tuple(3), identity(3));
+
+    CHECK(cache.lookup(make_tuple(1)).has_value());
+    CHECK(!cache.lookup(make_tuple(2)).has_value());
+    CHECK(cache.lookup(make_tuple(3)).has_value());
+    CHECK_EQ(1, cache.statistics().evictions);
+    CHECK_EQ(3, cache.statistics().hits);
+    CHECK_EQ(4, cache.statistics().misses);
+}
+
+TEST_CASE("CLOCK gives referenced arguments a second chance"){
+    MemoizationCache<int, int> cache(2, EvictionPolicy::Clock, 1);
+    auto identity = [](int value){ return [value](){ return value; }; };
+
+    cache.getOrCompute(make_tuple(1), identity(1));
+    cache.getOrCompute(make_tuple(2), identity(2));
+    cache.getOrCompute(make_tuple(1), identity(1));
+    cache.getOrCompute(make_tuple(3), identity(3));
+
+    CHECK(cache.lookup(make_tuple(1)).has_value());
+    CHECK(!cache.lookup(make_tuple(2)).has_value());
+    CHECK_EQ(3, cache.lookup(make_tuple(3)).value());
+}
+
+TEST_CASE("Bounded hash cache shared between threads"){
+    function<long long(int, int)> power = [](int base, int exponent) -> long long{
+        return pow(base, exponent);
+    };
+    auto cache = make_shared<MemoizationCache<long long, int, int>>(256, EvictionPolicy::Clock);
+    auto memoizedPower = memoizeWithCache(power, cache);
+
+    const int threadCount = 4;
+    const int callsPerThread = 10000;
+    vector<thread> threads;
+    vector<int> mismatches(threadCount, 0);
+    for(int threadIndex = 0; threadIndex < threadCount; ++threadIndex){
+        threads.emplace_back([&, threadIndex](){
+            for(int call = 0; call < callsPerThread; ++call){
+                const int base = 2 + call % 7;
+                const int exponent = call % 40;
+                if(memoizedPower(base, exponent) != power(base, exponent)) ++mismatches[threadIndex];
+            }
+        });
+    }
+    for(auto& aThread : threads) aThread.join();
+
+    auto statistics = cache->statistics();
+    CHECK_EQ(vector<int>(threadCount, 0), mismatches);
+    CHECK_EQ(threadCount * callsPerThread, statistics.hits + statistics.misses);
+    cout << "Shared cache: " << statistics.hits << " hits, " << statistics.misses << " misses, " << statistics.evictions << " evictions, " << statistics.size << "/" << statistics.capacity << " entries" << endl;
+}
+
+TEST_CASE("Recursive memoization with memoize_fix"){
+    auto power = memoize_fix<long long, int, int>([](auto& self, int base, int exponent) -> long long{
+        return (exponent == 0) ? 1 : base * self(base, exponent - 1);
+    });
+    auto factorial = memoize_fix<long long, int>([](auto& self, int n) -> long long{
+        return (n == 0) ? 1 : n * self(n - 1);
+    });
+    auto factorialWithTree = memoize_fix_with<TreeMemoTable<long long, int>>([](auto& self, int n) -> long long{
+        return (n == 0) ? 1 : n * self(n - 1);
+    });
+
+    CHECK_EQ(1, power(5, 0));
+    CHECK_EQ(1162261467, power(3, 19));
+    CHECK_EQ(33554432, power(2, 25));
+    CHECK_EQ(120, factorial(5));
+    CHECK_EQ(2432902008176640000LL, factorial(20));
+    CHECK_EQ(2432902008176640000LL, factorialWithTree(20));
+}
+
+TEST_CASE("memoize_fix vs hand-rolled recursive memoization"){
+    const int deepFactorial = 10000;
+
+    auto handRolledPower = [](int base, int exponent){
+        map<tuple<int, int>, unsigned long long> cache;
+        function<unsigned long long(int, int)> powerWithMemoization = [&](int base, int exponent) -> unsigned long long{
+            if(exponent == 0) return 1;
+            auto valueIterator = cache.find(make_tuple(base, exponent));
+            if(valueIterator != cache.end()) return valueIterator->second;
+            unsigned long long value = base * powerWithMemoization(base, exponent - 1);
+            cache[make_tuple(base, exponent)] = value;
+            return value;
+        };
+        return powerWithMemoization(base, exponent);
+    };
+
+    auto fixPower = [](int base, int exponent){
+        auto power = memoize_fix<unsigned long long, int, int>([](auto& self, int base, int exponent) -> unsigned long long{
+            return (exponent == 0) ? 1 : base * self(base, exponent - 1);
+        });
+        return power(base, exponent);
+    };
+
+    auto handRolledFactorial = [](int n){
+        map<int, unsigned long long> cache;
+        function<unsigned long long(int)> factorial = [&](int n) -> unsigned long long{
+            auto value = cache.find(n);
+            if(value != cache.end()) return value->second;
+            unsigned long long result = (n == 0) ? 1 : n * factorial(n - 1);
+            cache[n] = result;
+            return result;
+        };
+        return factorial(n);
+    };
+
+    auto fixFactorial = [](int n){
+        auto factorial = memoize_fix<unsigned long long, int>([](auto& self, int n) -> unsigned long long{
+            return (n == 0) ? 1 : n * self(n - 1);
+        });
+        return factorial(n);
+    };
+
+    printDuration("pow(3, 1024) hand-rolled recursive memoization: ", [&](){ return handRolledPower(3, 1024); });
+    printDuration("pow(3, 1024) with memoize_fix: ", [&](){ return fixPower(3, 1024); });
+    printDuration(to_string(deepFactorial) + "! hand-rolled recursive memoization: ", [&](){ return handRolledFactorial(deepFactorial); });
+    printDuration(to_string(deepFactorial) + "! with memoize_fix: ", [&](){ return fixFactorial(deepFactorial); });
+
+    CHECK_EQ(handRolledPower(3, 1024), fixPower(3, 1024));
+    CHECK_EQ(handRolledFactorial(deepFactorial), fixFactorial(deepFactorial));
+}
+
+TEST_CASE("Dense memoization for small integer domains"){
+    function<long long(int)> fact = [&fact](int n) -> long long{
+        return (n == 0) ? 1 : n * fact(n - 1);
+    };
+    auto memoizedFactorial = memoizeDense<long long, ArgumentRange<int, 0, 20>>(fact);
+
+    CHECK_EQ(1, memoizedFactorial(0));
+    CHECK_EQ(120, memoizedFactorial(5));
+    CHECK_EQ(120, memoizedFactorial(5));
+    CHECK_EQ(2432902008176640000LL, memoizedFactorial(20));
+
+    auto power = memoize_fix_with<DenseMemoTable<long long, ArgumentRange<int, 0, 9>, ArgumentRange<int, 0, 63>>>(
+        [](auto& self, int base, int exponent) -> long long{
+            return (exponent == 0) ? 1 : base * self(base, exponent - 1);
+        });
+
+    CHECK_EQ(1162261467, power(3, 19));
+    CHECK_EQ(33554432, power(2, 25));
+    SUBCASE("out of range arguments use the general cache"){
+        CHECK_EQ(1000000000000000000LL, power(10, 18));
+        CHECK_EQ(-1, power(-1, 63));
+        CHECK_EQ(1LL << 62, power(-2, 62));
+        CHECK_EQ(1, power(1, 100));
+        CHECK_EQ(0, power(0, 64));
+    }
+
+    SUBCASE("arguments far outside a range around zero"){
+        function<long long(int)> twice = [](int n) -> long long{ return 2LL * n; };
+        auto memoizedTwice = memoizeDense<long long, ArgumentRange<int, -10, 10>>(twice);
+        CHECK_EQ(-20, memoizedTwice(-10));
+        CHECK_EQ(2LL * numeric_limits<int>::max(), memoizedTwice(numeric_limits<int>::max()));
+        CHECK_EQ(2LL * numeric_limits<int>::min(), memoizedTwice(numeric_limits<int>::min()));
+    }
+}
+
+TEST_CASE("Dense vs hash vs tree memoization lookup cost"){
+    const int calls = 1000000;
+    auto factorialBody = [](auto& self, int n) -> long long{
+        return (n == 0) ? 1 : n * self(n - 1);
+    };
+    auto denseFactorial = memoize_fix_with<DenseMemoTable<long long, ArgumentRange<int, 0, 20>>>(factorialBody);
+    auto hashFactorial = memoize_fix_with<HashMemoTable<long long, int>>(factorialBody);
+    auto treeFactorial = memoize_fix_with<TreeMemoTable<long long, int>>(factorialBody);
+
+    auto nanosecondsPerHit = [&](auto& factorial, const string& name){
+        factorial(20);
+        long long checksum = 0;
+        auto result = runBenchmark(name, [&](){
+            checksum = 0;
+            for(int call = 0; call < calls; ++call) checksum += factorial(call % 21);
+            return checksum;
+        });
+        cout << name << " memoized factorial hit: " << result.median / calls << " ns (p99 " << result.p99 / calls << " ns)" << endl;
+        return checksum;
+    };
+
+    auto denseChecksum = nanosecondsPerHit(denseFactorial, "Dense");
+    auto hashChecksum = nanosecondsPerHit(hashFactorial, "Hash");
+    auto treeChecksum = nanosecondsPerHit(treeFactorial, "Tree");
+
+    CHECK_EQ(treeChecksum, denseChecksum);
+    CHECK_EQ(treeChecksum, hashChecksum);
+}
+
+// A file name no other test, nor another run of this binary, is using.
+auto uniqueTempPath = [](const string& name){
+    static int created = 0;
+    return (filesystem::temp_directory_path() / (name + "." + to_string(getpid()) + "." + to_string(++created))).string();
+};
+
+TEST_CASE("Persistent memoization survives a restart"){
+    const string path = uniqueTempPath("memoizedPower.cache");
+
+    int invocations = 0;
+    function<long long(int, int)> power = [&](int base, int exponent) -> long long{
+        ++invocations;
+        return pow(base, exponent);
+    };
+
+    {
+        auto memoizedPower = memoizePersistent(power, path, "power-v1");
+        CHECK_EQ(1162261467, memoizedPower(3, 19));
+        CHECK_EQ(1162261467, memoizedPower(3, 19));
+        CHECK_EQ(33554432, memoizedPower(2, 25));
+        CHECK_EQ(2, invocations);
+    }
+
+    SUBCASE("a new process reuses the mapped results"){
+        auto memoizedPower = memoizePersistent(power, path, "power-v1");
+        CHECK_EQ(1162261467, memoizedPower(3, 19));
+        CHECK_EQ(33554432, memoizedPower(2, 25));
+        CHECK_EQ(2, invocations);
+    }
+
+    SUBCASE("a different version starts from an empty file"){
+        auto memoizedPower = memoizePersistent(power, path, "power-v2");
+        CHECK_EQ(1162261467, memoizedPower(3, 19));
+        CHECK_EQ(3, invocations);
+    }
+
+    SUBCASE("a torn record is ignored and recomputed"){
+        typedef PersistentMemoizationCache<long long, int, int> Cache;
+        {
+            fstream file(path, ios::in | ios::out | ios::binary);
+            const auto recordCount = filesystem::file_size(path) / Cache::recordSize;
+            for(size_t record = 0; record < recordCount; ++record){
+                const auto lastByte = Cache::headerSize + (record + 1) * Cache::recordSize - 1;
+                if(lastByte >= filesystem::file_size(path)) break;
+                file.seekp(lastByte);
+                file.put(static_cast<char>(0x5a));
+            }
+        }
+        auto cache = make_shared<Cache>(path, "power-v1");
+        CHECK(!cache->lookup(make_tuple(3, 19)).has_value());
+
+        auto memoizedPower = memoizePersistent(power, cache);
+        CHECK_EQ(1162261467, memoizedPower(3, 19));
+        CHECK_EQ(3, invocations);
+        CHECK_EQ(1162261467, memoizedPower(3, 19));
+        CHECK_EQ(3, invocations);
+    }
+
+    filesystem::remove(path);
+}
+
+TEST_CASE("Persistent memoization grows past its initial capacity"){
+    const string path = uniqueTempPath("memoizedSquare.cache");
+    typedef PersistentMemoizationCache<long long, int> Cache;
+    const int entries = 100;
+
+    {
+        Cache cache(path, "square-v1", 8);
+        for(int value = 0; value < entries; ++value) cache.store(make_tuple(value), static_cast<long long>(value) * value);
+        CHECK_EQ(entries, cache.size());
+        CHECK_GE(cache.capacity() * 3, static_cast<uint64_t>(entries) * 4);
+        for(int value = 0; value < entries; ++value) CHECK_EQ(static_cast<long long>(value) * value, cache.lookup(make_tuple(value)).value());
+    }
+
+    SUBCASE("the grown file is reopened as it is"){
+        Cache cache(path, "square-v1", 8);
+        CHECK_EQ(entries, cache.size());
+        CHECK_EQ(99LL * 99LL, cache.lookup(make_tuple(99)).value());
+    }
+
+    SUBCASE("a writer follows a file replaced by another writer"){
+        Cache first(path, "square-v1");
+        Cache second(path, "square-v1");
+        const uint64_t capacity = first.capacity();
+        for(int value = entries; first.capacity() == capacity; ++value) first.store(make_tuple(value), 1);
+
+        CHECK(!second.lookup(make_tuple(-1)).has_value());
+        second.store(make_tuple(-1), 1);
+        CHECK_EQ(first.capacity(), second.capacity());
+        CHECK_EQ(1, first.lookup(make_tuple(-1)).value());
+        CHECK_EQ(first.size(), second.size());
+    }
+
+    filesystem::remove(path);
+}
+
+TEST_CASE("Persistent memoization warm start"){
+    const string path = uniqueTempPath("memoizedSquare.cache");
+    const int entries = 100000;
+    function<long long(int)> square = [](int value) -> long long{ return static_cast<long long>(value) * value; };
+
+    {
+        auto cache = make_shared<PersistentMemoizationCache<long long, int>>(path, "square-v1");
+        auto memoizedSquare = memoizePersistent(square, cache);
+        for(int value = 0; value < entries; ++value) memoizedSquare(value);
+        cache->sync();
+    }
+
+    shared_ptr<PersistentMemoizationCache<long long, int>> cache;
+    printDuration("Reopening a persistent cache: ", [&](){
+        cache = make_shared<PersistentMemoizationCache<long long, int>>(path, "square-v1");
+    });
+    CHECK_EQ(entries, cache->size());
+    CHECK_EQ(99999LL * 99999LL, cache->lookup(make_tuple(99999)).value());
+
+    filesystem::remove(path);
+}
+
+TEST_CASE("Precomputed function tables"){
+    static_assert(factorialTable(20) == 2432902008176640000ULL, "computed at compile time");
+    static_assert(factorial64(5) == 120, "computed at compile time");
+    for(int n = 0; n <= 20; ++n) CHECK_EQ(factorialByLoop(n), factorial64(n));
+    CHECK_THROWS_AS(factorial64(21), out_of_range);
+    CHECK_THROWS_AS(factorial64(-1), out_of_range);
+
+    auto power = [](int base, int exponent){
+        long long result = 1;
+        for(int i = 0; i < exponent; ++i) result *= base;
+        return result;
+    };
+    typedef FunctionTable<long long, ArgumentRange<int, 0, 9>, ArgumentRange<int, 0, 19>> PowerTable;
+    ThreadPool pool(4);
+    PowerTable sequentialPowers(power);
+    PowerTable parallelPowers(pool, power);
+
+    for(int base = 0; base <= 9; ++base){
+        for(int exponent = 0; exponent <= 19; ++exponent){
+            CHECK_EQ(power(base, exponent), sequentialPowers(base, exponent));
+            CHECK_EQ(power(base, exponent), parallelPowers(base, exponent));
+        }
+    }
+    CHECK_EQ(1162261467, parallelPowers.at(3, 19));
+    CHECK_THROWS_AS(parallelPowers.at(3, 20), out_of_range);
+}
+
+TEST_CASE("Arbitrary precision factorial"){
+    CHECK_EQ("1", factorialBig(0).toString());
+    CHECK_EQ("1", factorialBig(1).toString());
+    CHECK_EQ("2432902008176640000", factorialBig(20).toString());
+    CHECK_EQ("51090942171709440000", factorialBig(21).toString());
+
+    const string factorial1024 = factorialBig(1024).toString();
+    CHECK_EQ(2640, factorial1024.size());
+    CHECK_EQ("54185287960588572830", factorial1024.substr(0, 20));
+    CHECK_EQ(253, factorial1024.size() - factorial1024.find_last_not_of('0') - 1);
+
+    const string factorial10000 = factorialBig(10000).toString();
+    CHECK_EQ(35660, factorial10000.size());
+    CHECK_EQ("28462596809170545189", factorial10000.substr(0, 20));
+    CHECK_EQ(2499, factorial10000.size() - factorial10000.find_last_not_of('0') - 1);
+
+    ThreadPool pool(4);
+    CHECK(factorialBig(10000) == factorialBig(10000, pool));
+    CHECK(factorialBig(5) == factorialBig(5, pool));
+    CHECK(factorialBig(0) == factorialBig(0, pool));
+}
+
+TEST_CASE("Karatsuba agrees with schoolbook multiplication"){
+    uint32_t state = 12345;
+    auto randomLimbs = [&state](const size_t count){
+        vector<uint32_t> limbs(count);
+        for(auto& limb : limbs){
+            state = state * 1664525u + 1013904223u;
+            limb = state;
+        }
+        limbs.back() |= 1;
+        return limbs;
+    };
+
+    for(const auto& [firstSize, secondSize] : vector<pair<size_t, size_t>>{{1, 1}, {50, 50}, {200, 49}, {300, 700}, {1024, 1024}}){
+        const auto first = randomLimbs(firstSize);
+        const auto second = randomLimbs(secondSize);
+        CHECK_EQ(BigUnsigned::multiplySchoolbook(first, second), BigUnsigned::multiplyKaratsuba(first, second));
+    }
+    CHECK_EQ("36893488130239234050", (BigUnsigned(0xFFFFFFFFULL) * BigUnsigned(0xFFFFFFFFULL) + BigUnsigned(0xFFFFFFFFULL) * BigUnsigned(0xFFFFFFFFULL)).toString());
+}
+
+TEST_CASE("Factorial table vs memoized factorial vs product tree"){
+    BenchmarkOptions options;
+    options.warmupRuns = 1;
+    options.samples = 5;
+    const int calls = 1000000;
+
+    auto memoizedFactorial = memoize_fix<unsigned long long, int>([](auto& self, int n) -> unsigned long long{
+        return (n == 0) ? 1 : n * self(n - 1);
+    });
+    printBenchmark(runBenchmark("10^6 lookups, memoized factorial: ", [&](){
+        unsigned long long checksum = 0;
+        for(int call = 0; call < calls; ++call) checksum += memoizedFactorial(call % 21);
+        return checksum;
+    }, options));
+    printBenchmark(runBenchmark("10^6 lookups, constexpr factorial table: ", [&](){
+        unsigned long long checksum = 0;
+        for(int call = 0; call < calls; ++call) checksum += factorialTable(call % 21);
+        return checksum;
+    }, options));
+
+    auto sequentialProduct = [](const uint64_t n){
+        BigUnsigned result(1);
+        for(uint64_t value = 2; value <= n; ++value) result = result * BigUnsigned(value);
+        return result;
+    };
+    ThreadPool pool;
+    printBenchmark(runBenchmark("10000! one factor at a time: ", [&](){ return sequentialProduct(10000).asLimbs().size(); }, options));
+    printBenchmark(runBenchmark("10000! product tree: ", [&](){ return factorialBig(10000).asLimbs().size(); }, options));
+    printBenchmark(runBenchmark("10000! product tree on the pool: ", [&](){ return factorialBig(10000, pool).asLimbs().size(); }, options));
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+// Finalizer from splitmix64; std::hash<int> is the identity on libstdc++,
+// so without it consecutive arguments would land in consecutive slots.
+inline size_t mixHash(size_t value){
+    uint64_t x = value;
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return static_cast<size_t>(x);
+}
+
+template<typename... Args>
+size_t hashTuple(const tuple<Args...>& arguments){
+    size_t seed = 0;
+    apply([&seed](const auto&... argument){
+        ((seed ^= hash<decay_t<decltype(argument)>>{}(argument) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)), ...);
+    }, arguments);
+    return mixHash(seed);
+}
+
+struct TupleHash{
+    template<typename... Args>
+    size_t operator()(const tuple<Args...>& arguments) const{
+        return hashTuple(arguments);
+    }
+};
+
+enum class EvictionPolicy {LRU, Clock};
+
+struct CacheStatistics{
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t size;
+    size_t capacity;
+};
+
+// Bounded memoization cache shared by many threads.
+// Keys are split across shards by hash; every shard owns a mutex, a dense
+// array of entries and an open addressing (linear probing) index into it.
+template<typename ReturnType, typename... Args>
+class MemoizationCache{
+    private:
+        typedef tuple<Args...> Key;
+        static constexpr uint32_t None = numeric_limits<uint32_t>::max();
+
+        struct Entry{
+            Key key;
+            ReturnType value;
+            size_t hash;
+            uint32_t previous;
+            uint32_t next;
+            bool referenced;
+        };
+
+        struct alignas(64) Shard{
+            mutable mutex lock;
+            vector<Entry> entries;
+            vector<uint32_t> index;
+            size_t mask = 0;
+            size_t capacity = 0;
+            uint32_t mostRecent = None;
+            uint32_t leastRecent = None;
+            uint32_t clockHand = 0;
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t evictions = 0;
+        };
+
+        const EvictionPolicy policy;
+        const size_t shardCount;
+        const size_t totalCapacity;
+        unique_ptr<Shard[]> shards;
+
+        Shard& shardFor(const size_t hash) const{
+            return shards[(hash >> 32) % shardCount];
+        }
+
+        size_t slotFor(const Shard& shard, const size_t hash, const uint32_t entryIndex) const{
+            size_t slot = hash & shard.mask;
+            while(shard.index[slot] != entryIndex) slot = (slot + 1) & shard.mask;
+            return slot;
+        }
+
+        uint32_t find(const Shard& shard, const Key& key, const size_t hash) const{
+            for(size_t slot = hash & shard.mask; shard.index[slot] != None; slot = (slot + 1) & shard.mask){
+                const Entry& entry = shard.entries[shard.index[slot]];
+                if(entry.hash == hash && entry.key == key) return shard.index[slot];
+            }
+            return None;
+        }
+
+        // Backward shift deletion keeps probe sequences intact without tombstones.
+        void eraseFromIndex(Shard& shard, size_t slot){
+            size_t next = slot;
+            while(true){
+                next = (next + 1) & shard.mask;
+                if(shard.index[next] == None) break;
+                const size_t home = shard.entries[shard.index[next]].hash & shard.mask;
+                const bool canMove = (next > slot) ? (home <= slot || home > next) : (home <= slot && home > next);
+                if(canMove){
+                    shard.index[slot] = shard.index[next];
+                    slot = next;
+                }
+            }
+            shard.index[slot] = None;
+        }
+
+        void insertIntoIndex(Shard& shard, const size_t hash, const uint32_t entryIndex){
+            size_t slot = hash & shard.mask;
+            while(shard.index[slot] != None) slot = (slot + 1) & shard.mask;
+            shard.index[slot] = entryIndex;
+        }
+
+        void unlink(Shard& shard, const uint32_t entryIndex){
+            Entry& entry = shard.entries[entryIndex];
+            if(entry.previous != None) shard.entries[entry.previous].next = entry.next;
+            else shard.mostRecent = entry.next;
+            if(entry.next != None) shard.entries[entry.next].previous = entry.previous;
+            else shard.leastRecent = entry.previous;
+        }
+
+        void pushFront(Shard& shard, const uint32_t entryIndex){
+            Entry& entry = shard.entries[entryIndex];
+            entry.previous = None;
+            entry.next = shard.mostRecent;
+            if(shard.mostRecent != None) shard.entries[shard.mostRecent].previous = entryIndex;
+            shard.mostRecent = entryIndex;
+            if(shard.leastRecent == None) shard.leastRecent = entryIndex;
+        }
+
+        void touch(Shard& shard, const uint32_t entryIndex){
+            if(policy == EvictionPolicy::Clock){
+                shard.entries[entryIndex].referenced = true;
+            } else if(shard.mostRecent != entryIndex){
+                unlink(shard, entryIndex);
+                pushFront(shard, entryIndex);
+            }
+        }
+
+        uint32_t chooseVictim(Shard& shard){
+            if(policy == EvictionPolicy::LRU) return shard.leastRecent;
+            while(shard.entries[shard.clockHand].referenced){
+                shard.entries[shard.clockHand].referenced = false;
+                shard.clockHand = (shard.clockHand + 1) % shard.entries.size();
+            }
+            const uint32_t victim = shard.clockHand;
+            shard.clockHand = (shard.clockHand + 1) % shard.entries.size();
+            return victim;
+        }
+
+        void insert(Shard& shard, const Key& key, const size_t hash, const ReturnType& value){
+            uint32_t entryIndex;
+            if(shard.entries.size() < shard.capacity){
+                entryIndex = static_cast<uint32_t>(shard.entries.size());
+                shard.entries.push_back(Entry{key, value, hash, None, None, false});
+            } else {
+                entryIndex = chooseVictim(shard);
+                Entry& victim = shard.entries[entryIndex];
+                eraseFromIndex(shard, slotFor(shard, victim.hash, entryIndex));
+                if(policy == EvictionPolicy::LRU) unlink(shard, entryIndex);
+                victim.key = key;
+                victim.value = value;
+                victim.hash = hash;
+                victim.referenced = false;
+                ++shard.evictions;
+            }
+            insertIntoIndex(shard, hash, entryIndex);
+            if(policy == EvictionPolicy::LRU) pushFront(shard, entryIndex);
+        }
+
+    public:
+        MemoizationCache(const size_t capacity, const EvictionPolicy policy = EvictionPolicy::LRU, const size_t shardCount = 16) :
+            policy(policy),
+            shardCount(max<size_t>(1, min(shardCount, capacity))),
+            totalCapacity(capacity),
+            shards(new Shard[this->shardCount]){
+            for(size_t i = 0; i < this->shardCount; ++i){
+                Shard& shard = shards[i];
+                // The remainder goes to the first shards, so the shards add up to capacity exactly.
+                shard.capacity = max<size_t>(1, capacity / this->shardCount + ((i < capacity % this->shardCount) ? 1 : 0));
+                size_t slots = 2;
+                while(slots < 2 * shard.capacity) slots *= 2;
+                shard.index.assign(slots, None);
+                shard.mask = slots - 1;
+                shard.entries.reserve(shard.capacity);
+            }
+        };
+
+        MemoizationCache(const MemoizationCache&) = delete;
+        MemoizationCache& operator=(const MemoizationCache&) = delete;
+
+        optional<ReturnType> lookup(const Key& key){
+            const size_t hash = hashTuple(key);
+            Shard& shard = shardFor(hash);
+            lock_guard<mutex> guard(shard.lock);
+            const uint32_t entryIndex = find(shard, key, hash);
+            if(entryIndex == None){
+                ++shard.misses;
+                return nullopt;
+            }
+            ++shard.hits;
+            touch(shard, entryIndex);
+            return shard.entries[entryIndex].value;
+        }
+
+        // The computation runs outside the shard lock; memoized functions are pure,
+        // so two threads racing on the same key compute the same value.
+        template<typename F>
+        ReturnType getOrCompute(const Key& key, F compute){
+            const size_t hash = hashTuple(key);
+            Shard& shard = shardFor(hash);
+            {
+                lock_guard<mutex> guard(shard.lock);
+                const uint32_t entryIndex = find(shard, key, hash);
+                if(entryIndex != None){
+                    ++shard.hits;
+                    touch(shard, entryIndex);
+                    return shard.entries[entryIndex].value;
+                }
+                ++shard.misses;
+            }
+
+            ReturnType result = compute();
+
+            lock_guard<mutex> guard(shard.lock);
+            if(find(shard, key, hash) == None) insert(shard, key, hash, result);
+            return result;
+        }
+
+        CacheStatistics statistics() const{
+            CacheStatistics statistics{0, 0, 0, 0, totalCapacity};
+            for(size_t i = 0; i < shardCount; ++i){
+                lock_guard<mutex> guard(shards[i].lock);
+                statistics.hits += shards[i].hits;
+                statistics.misses += shards[i].misses;
+                statistics.evictions += shards[i].evictions;
+                statistics.size += shards[i].entries.size();
+            }
+            return statistics;
+        }
+};
+
+template<typename ReturnType, typename... Args>
+function<ReturnType(Args...)> memoizeWithCache(function<ReturnType(Args...)> f, shared_ptr<MemoizationCache<ReturnType, Args...>> cache){
+    return [f, cache](Args... args){
+        return cache->getOrCompute(tuple<Args...>(args...), [&](){ return f(args...); });
+    };
+};
+
+template<typename ReturnType, typename... Args>
+function<ReturnType(Args...)> memoizeWithCache(function<ReturnType(Args...)> f, const size_t capacity, const EvictionPolicy policy = EvictionPolicy::LRU){
+    return memoizeWithCache(f, make_shared<MemoizationCache<ReturnType, Args...>>(capacity, policy));
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include "memoizationCache.h"
+
+using namespace std;
+
+// Tables used by memoize_fix. A table exposes lookup(), returning a pointer to
+// the cached value or nullptr, and store().
+template<typename ReturnType, typename... Args>
+class HashMemoTable{
+    private:
+        unordered_map<tuple<Args...>, ReturnType, TupleHash> values;
+
+    public:
+        typedef ReturnType result_type;
+        typedef tuple<Args...> key_type;
+
+        const ReturnType* lookup(const key_type& key) const{
+            auto value = values.find(key);
+            return (value == values.end()) ? nullptr : &value->second;
+        }
+
+        void store(const key_type& key, const ReturnType& value){
+            values.emplace(key, value);
+        }
+};
+
+template<typename ReturnType, typename... Args>
+class TreeMemoTable{
+    private:
+        map<tuple<Args...>, ReturnType> values;
+
+    public:
+        typedef ReturnType result_type;
+        typedef tuple<Args...> key_type;
+
+        const ReturnType* lookup(const key_type& key) const{
+            auto value = values.find(key);
+            return (value == values.end()) ? nullptr : &value->second;
+        }
+
+        void store(const key_type& key, const ReturnType& value){
+            values.emplace(key, value);
+        }
+};
+
+// Memoized fixpoint of f(self, args...). The recursive calls go through
+// `self`, which is this object, so every level is a direct call followed by
+// a table lookup; there is no std::function anywhere in the recursion.
+template<typename Table, typename F>
+class MemoizedFixpoint{
+    private:
+        F f;
+        Table table;
+
+    public:
+        typedef typename Table::result_type result_type;
+
+        explicit MemoizedFixpoint(F f) : f(f){};
+
+        template<typename... CallArgs>
+        result_type operator()(const CallArgs&... args){
+            const typename Table::key_type key(args...);
+            if(const result_type* cached = table.lookup(key)) return *cached;
+            result_type result = f(*this, args...);
+            table.store(key, result);
+            return result;
+        }
+};
+
+template<typename Table, typename F>
+auto memoize_fix_with(F f){
+    return MemoizedFixpoint<Table, F>(f);
+};
+
+template<typename ReturnType, typename... Args, typename F>
+auto memoize_fix(F f){
+    return memoize_fix_with<HashMemoTable<ReturnType, Args...>>(f);
+};
@@ -6,6 +6,10 @@
 #include <numeric>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "benchmark.h"
+#include "pipeline.h"
+#include "telemetry.h"
+#include "hugePageAllocator.h"
 
 using namespace std;
 using namespace std::placeholders;
@@ -27,11 +31,13 @@ auto transformAll = [](const auto& source, auto lambda){
 };
 
 TEST_CASE("Memory"){
+    telemetry::Region memory("Memory");
     auto size = size_1GB_64Bits;
     vector<long long> manyNumbers(size);
     fill_n(manyNumbers.begin(), size, 1000L);
 
-    auto result = transformAll<vector<long long>>(manyNumbers, increment);
+    vector<long long> result;
+    printColdDuration("transformAll: ", [&](){ telemetry::Region region("transformAll"); result = transformAll<vector<long long>>(manyNumbers, increment); });
 
     CHECK_EQ(result[0], 1001);
 }
@@ -49,11 +55,13 @@ auto transformAllInPlace = [](auto& source, auto lambda) -> SourceType&& {
 };
 
 TEST_CASE("Memory"){
+    telemetry::Region memory("Memory");
     auto size = size_1GB_64Bits;
     vector<long long> manyNumbers(size);
     fill_n(manyNumbers.begin(), size, 1000L);
 
-    auto result = transformAllInPlace<vector<long long>>(manyNumbers, increment);
+    vector<long long> result;
+    printColdDuration("transformAllInPlace: ", [&](){ telemetry::Region region("transformAllInPlace"); result = transformAllInPlace<vector<long long>>(manyNumbers, increment); });
 
     CHECK_EQ(result[0], 1001);
 }
@@ -73,11 +81,13 @@ auto transformAllWithMoveIterator = [](auto& source, auto lambda){
 };
 
 TEST_CASE("Memory"){
+    telemetry::Region memory("Memory");
     auto size = size_1GB_64Bits;
     vector<long long> manyNumbers(size);
     fill_n(manyNumbers.begin(), size, 1000L);
 
-    auto result = transformAllWithMoveIterator<vector<long long>>(manyNumbers, increment);
+    vector<long long> result;
+    printColdDuration("transformAllWithMoveIterator: ", [&](){ telemetry::Region region("transformAllWithMoveIterator"); result = transformAllWithMoveIterator<vector<long long>>(manyNumbers, increment); });
 
     CHECK_EQ(result[0], 1001);
 }
@@ -85,14 +95,140 @@ TEST_CASE("Memory"){
 
 #if FOR
 TEST_CASE("Memory"){
+    telemetry::Region memory("Memory");
     auto size = size_1GB_64Bits;
     vector<long long> manyNumbers(size);
     fill_n(manyNumbers.begin(), size, 1000L);
 
-    for(auto iter = manyNumbers.begin(); iter != manyNumbers.end(); ++iter){
-        ++(*iter);
-    };
+    printColdDuration("for loop: ", [&](){
+        telemetry::Region region("for loop");
+        for(auto iter = manyNumbers.begin(); iter != manyNumbers.end(); ++iter){
+            ++(*iter);
+        };
+    });
 
     CHECK_EQ(manyNumbers[0], 1001);
 }
 #endif
+
+#if FUSED
+auto increment = [](const auto value){
+    return value + 1;
+};
+
+TEST_CASE("Memory"){
+    telemetry::Region memory("Memory");
+    auto size = size_1GB_64Bits;
+    vector<long long> manyNumbers(size);
+    fill_n(manyNumbers.begin(), size, 1000L);
+
+    vector<long long> result;
+    printColdDuration("fused pipeline: ", [&](){ telemetry::Region region("fused pipeline"); result = move(manyNumbers) | fused::map(increment) | fused::collect(); });
+
+    CHECK_EQ(result[0], 1001);
+    CHECK_EQ(result.size(), size);
+}
+
+TEST_CASE("Fused pipeline"){
+    vector<int> numbers{1, 2, 3, 4, 5, 6};
+    auto isEven = [](const int value){ return value % 2 == 0; };
+    auto timesTen = [](const int value){ return value * 10; };
+
+    vector<int> evenTimesTen;
+    numbers | fused::filter(isEven) | fused::map(timesTen) | fused::into(evenTimesTen);
+    CHECK_EQ(vector<int>{20, 40, 60}, evenTimesTen);
+    CHECK_EQ(6, numbers.size());
+
+    auto halves = numbers | fused::map([](const int value){ return value / 2.0; }) | fused::collect();
+    CHECK_EQ(vector<double>{0.5, 1, 1.5, 2, 2.5, 3}, halves);
+
+    const int* buffer = numbers.data();
+    auto incrementedOdd = move(numbers) | fused::map(increment) | fused::filter([](const int value){ return value % 2 == 1; }) | fused::collect();
+    CHECK_EQ(vector<int>{3, 5, 7}, incrementedOdd);
+    CHECK_EQ(buffer, incrementedOdd.data());
+}
+#endif
+
+#if HUGE_PAGES
+auto increment = [](const auto value){
+    return value + 1;
+};
+
+template<typename DestinationType>
+auto transformAllWithAllocator = [](const auto& source, auto lambda, const typename DestinationType::allocator_type& allocator){
+    DestinationType result(source.size(), allocator);
+    parallel::transform(parallel::par, source.begin(), source.end(), result.begin(), lambda);
+    return result;
+};
+
+template<typename DestinationType>
+void printPageFaults(const string& message, const vector<long long>& manyNumbers, const typename DestinationType::allocator_type& allocator){
+    DestinationType result;
+    telemetry::Region region(message);
+    const PageFaultMeasurement measurement = measurePageFaults([&](){
+        result = transformAllWithAllocator<DestinationType>(manyNumbers, increment, allocator);
+    });
+    cout << message << measurement.duration.count() << " ns, " << measurement.minorFaults << " minor and "
+        << measurement.majorFaults << " major page faults" << endl;
+
+    CHECK_EQ(result[0], 1001);
+    CHECK_EQ(result[result.size() - 1], 1001);
+}
+
+TEST_CASE("huge page allocator"){
+    HugePageAllocator<long long> allocator;
+
+    vector<long long, HugePageAllocator<long long>> small(1000, 7, allocator);
+    CHECK_EQ(7, small[999]);
+
+    vector<long long, HugePageAllocator<long long>> large(hugePageSize, 7, allocator);
+    CHECK_EQ(0, reinterpret_cast<uintptr_t>(large.data()) % hugePageSize);
+    CHECK_EQ(7, large[0]);
+    CHECK_EQ(7, large[hugePageSize - 1]);
+
+    large.resize(2 * hugePageSize, 1);
+    CHECK_EQ(7, large[hugePageSize - 1]);
+    CHECK_EQ(1, large[2 * hugePageSize - 1]);
+
+    HugePageOptions interleaved;
+    interleaved.placement = NumaPlacement::Interleave;
+    interleaved.prefault = false;
+    vector<int, HugePageAllocator<int>> spread(hugePageSize, 3, HugePageAllocator<int>(interleaved));
+    CHECK_EQ(3, spread[hugePageSize / 2]);
+
+    CHECK_GE(numaNodeCount(), 1);
+
+    struct alignas(128) CacheLines{
+        char bytes[128];
+    };
+    vector<CacheLines, HugePageAllocator<CacheLines>> aligned(3);
+    CHECK_EQ(0, reinterpret_cast<uintptr_t>(aligned.data()) % 128);
+
+    HugePageOptions missingNode;
+    missingNode.placement = NumaPlacement::Node;
+    missingNode.numaNode = numaNodeCount();
+    missingNode.prefault = false;
+    typedef vector<int, HugePageAllocator<int>> HugePageInts;
+    HugePageInts firstTouch(hugePageSize, 5, HugePageAllocator<int>(missingNode));
+    CHECK_EQ(5, firstTouch[hugePageSize - 1]);
+    missingNode.strictPlacement = true;
+    CHECK_THROWS_AS(HugePageInts(hugePageSize, 5, HugePageAllocator<int>(missingNode)), system_error);
+}
+
+TEST_CASE("Memory"){
+    telemetry::Region memory("Memory");
+    auto size = size_1GB_64Bits;
+    vector<long long> manyNumbers(size);
+    fill_n(manyNumbers.begin(), size, 1000L);
+
+    typedef vector<long long, HugePageAllocator<long long>> HugePageVector;
+    HugePageOptions transparentOnly;
+    transparentOnly.explicitHugePages = false;
+    transparentOnly.prefault = false;
+    HugePageOptions prefaulted;
+
+    printPageFaults<vector<long long>>("std::allocator: ", manyNumbers, allocator<long long>());
+    printPageFaults<HugePageVector>("huge pages: ", manyNumbers, HugePageAllocator<long long>(transparentOnly));
+    printPageFaults<HugePageVector>("huge pages, prefaulted in parallel: ", manyNumbers, HugePageAllocator<long long>(prefaulted));
+}
+#endif
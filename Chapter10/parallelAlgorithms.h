@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include "threadPool.h"
+
+using namespace std;
+
+// Execution policies and parallel algorithms on top of ThreadPool, for
+// toolchains where <execution> needs TBB or is missing altogether.
+namespace parallel{
+    struct SequencedPolicy{};
+
+    struct ParallelPolicy{
+        ThreadPool* pool = nullptr;
+        size_t grain = 0;
+    };
+
+    // Same scheduling as ParallelPolicy; the per element loops of transform
+    // are additionally marked free of loop carried dependencies.
+    struct ParallelUnsequencedPolicy : ParallelPolicy{};
+
+    const SequencedPolicy seq{};
+    const ParallelPolicy par{};
+    const ParallelUnsequencedPolicy par_unseq{};
+
+    template<typename Policy>
+    constexpr bool isSequenced = is_same<decay_t<Policy>, SequencedPolicy>::value;
+
+    inline ThreadPool& defaultThreadPool(){
+        static ThreadPool pool;
+        return pool;
+    }
+
+    inline ThreadPool& poolFor(const ParallelPolicy& policy){
+        return (policy.pool != nullptr) ? *policy.pool : defaultThreadPool();
+    }
+
+    // An explicit grain is rounded up to a multiple of 64 like the computed one,
+    // since the output may be a vector<bool>.
+    inline size_t grainFor(const ParallelPolicy& policy, const size_t size){
+        return (policy.grain != 0) ? (policy.grain + 63) / 64 * 64 : grainSizeFor(size, poolFor(policy).size());
+    }
+
+    // Number of chunks forEachChunk splits `size` elements into. Inputs smaller
+    // than two grains are not worth a trip through the pool.
+    inline size_t chunkCountFor(const ParallelPolicy& policy, const size_t size){
+        const size_t grain = grainFor(policy, size);
+        if(size < 2 * grain || poolFor(policy).size() == 1) return 1;
+        return (size + grain - 1) / grain;
+    }
+
+    // Calls chunk(begin, end, index) for consecutive ranges covering [0, size)
+    // and waits for all of them, even when one throws, before rethrowing the
+    // first failure.
+    template<typename Chunk>
+    void forEachChunk(const ParallelPolicy& policy, const size_t size, Chunk chunk){
+        if(chunkCountFor(policy, size) == 1){
+            chunk(size_t(0), size, size_t(0));
+            return;
+        }
+
+        ThreadPool& pool = poolFor(policy);
+        const size_t grain = grainFor(policy, size);
+        vector<PoolFuture<void>> chunks;
+        size_t index = 0;
+        for(size_t begin = 0; begin < size; begin += grain, ++index){
+            const size_t end = min(size, begin + grain);
+            chunks.push_back(pool.submit([&chunk, begin, end, index](){ chunk(begin, end, index); }));
+        }
+        for(auto& aChunk : chunks) aChunk.wait();
+        for(auto& aChunk : chunks) aChunk.get();
+    }
+
+    template<typename Policy, typename InputIterator, typename OutputIterator, typename UnaryOperation>
+    OutputIterator transform(const Policy& policy, InputIterator first, InputIterator last, OutputIterator destination, UnaryOperation operation){
+        if constexpr(isSequenced<Policy>){
+            return std::transform(first, last, destination, operation);
+        } else {
+            const size_t size = distance(first, last);
+            forEachChunk(policy, size, [&](size_t begin, size_t end, size_t){
+                auto source = first + begin;
+                auto target = destination + begin;
+                if constexpr(is_same<decay_t<Policy>, ParallelUnsequencedPolicy>::value){
+#pragma GCC ivdep
+                    for(size_t i = 0; i < end - begin; ++i) target[i] = operation(source[i]);
+                } else {
+                    std::transform(source, source + (end - begin), target, operation);
+                }
+            });
+            return destination + size;
+        }
+    }
+
+    // `operation` must be associative: chunks are reduced independently and
+    // their partial results combined left to right.
+    template<typename Policy, typename InputIterator, typename T, typename BinaryOperation = std::plus<>>
+    T reduce(const Policy& policy, InputIterator first, InputIterator last, T initialValue, BinaryOperation operation = BinaryOperation()){
+        if constexpr(isSequenced<Policy>){
+            return std::accumulate(first, last, initialValue, operation);
+        } else {
+            const size_t size = distance(first, last);
+            if(size == 0) return initialValue;
+            vector<optional<T>> partials(chunkCountFor(policy, size));
+            forEachChunk(policy, size, [&](size_t begin, size_t end, size_t index){
+                partials[index] = std::accumulate(first + begin + 1, first + end, T(first[begin]), operation);
+            });
+            T result = initialValue;
+            for(auto& partial : partials){
+                if(partial) result = operation(result, *partial);
+            }
+            return result;
+        }
+    }
+
+    // True when some element satisfies `predicate`. Chunks poll a shared flag
+    // so the search stops soon after any of them finds a match.
+    template<typename Policy, typename InputIterator, typename Predicate>
+    bool any_of(const Policy& policy, InputIterator first, InputIterator last, Predicate predicate){
+        if constexpr(isSequenced<Policy>){
+            return std::any_of(first, last, predicate);
+        } else {
+            const size_t blockSize = 4096;
+            atomic<bool> found(false);
+            forEachChunk(policy, distance(first, last), [&](size_t begin, size_t end, size_t){
+                for(size_t block = begin; block < end && !found.load(memory_order_relaxed); block += blockSize){
+                    if(std::any_of(first + block, first + min(end, block + blockSize), predicate)){
+                        found.store(true, memory_order_relaxed);
+                    }
+                }
+            });
+            return found.load();
+        }
+    }
+
+    template<typename Policy, typename InputIterator, typename Predicate>
+    bool all_of(const Policy& policy, InputIterator first, InputIterator last, Predicate predicate){
+        return !parallel::any_of(policy, first, last, [&predicate](const auto& value){ return !predicate(value); });
+    }
+
+    template<typename Policy, typename InputIterator, typename Predicate>
+    bool none_of(const Policy& policy, InputIterator first, InputIterator last, Predicate predicate){
+        return !parallel::any_of(policy, first, last, predicate);
+    }
+
+    // Stable: a first pass counts the matches of every chunk, a prefix sum gives
+    // each chunk its output offset, and a second pass copies.
+    template<typename Policy, typename InputIterator, typename OutputIterator, typename Predicate>
+    OutputIterator copy_if(const Policy& policy, InputIterator first, InputIterator last, OutputIterator destination, Predicate predicate){
+        if constexpr(isSequenced<Policy>){
+            return std::copy_if(first, last, destination, predicate);
+        } else {
+            const size_t size = distance(first, last);
+            vector<size_t> offsets(chunkCountFor(policy, size) + 1, 0);
+            forEachChunk(policy, size, [&](size_t begin, size_t end, size_t index){
+                offsets[index + 1] = std::count_if(first + begin, first + end, predicate);
+            });
+            partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            forEachChunk(policy, size, [&](size_t begin, size_t end, size_t index){
+                std::copy_if(first + begin, first + end, destination + offsets[index], predicate);
+            });
+            return destination + offsets.back();
+        }
+    }
+
+    // Sorts the chunks in parallel, then merges neighbouring runs in parallel
+    // rounds until a single run is left.
+    template<typename Policy, typename RandomIterator, typename Compare = std::less<>>
+    void sort(const Policy& policy, RandomIterator first, RandomIterator last, Compare compare = Compare()){
+        if constexpr(isSequenced<Policy>){
+            std::sort(first, last, compare);
+        } else {
+            const size_t size = distance(first, last);
+            if(chunkCountFor(policy, size) == 1){
+                std::sort(first, last, compare);
+                return;
+            }
+            const size_t runLength = grainFor(policy, size);
+            forEachChunk(policy, size, [&](size_t begin, size_t end, size_t){
+                std::sort(first + begin, first + end, compare);
+            });
+
+            ThreadPool& pool = poolFor(policy);
+            for(size_t width = runLength; width < size; width *= 2){
+                vector<PoolFuture<void>> merges;
+                for(size_t begin = 0; begin + width < size; begin += 2 * width){
+                    const size_t middle = begin + width;
+                    const size_t end = min(size, begin + 2 * width);
+                    merges.push_back(pool.submit([&compare, first, begin, middle, end](){
+                        inplace_merge(first + begin, first + middle, first + end, compare);
+                    }));
+                }
+                for(auto& merge : merges) merge.wait();
+                for(auto& merge : merges) merge.get();
+            }
+        }
+    }
+}
+
+template<typename DestinationType>
+auto transformAllWithPolicy = [](const auto& policy, const auto& source, auto lambda){
+    DestinationType result(source.size());
+    parallel::transform(policy, source.begin(), source.end(), result.begin(), lambda);
+    return result;
+};
+
+auto accumulateAllWithPolicy = [](const auto& policy, const auto& source, auto initialValue, auto lambda){
+    return parallel::reduce(policy, source.begin(), source.end(), initialValue, lambda);
+};
@@ -1,14 +1,18 @@
 // At the time when I created this file, only MSVC had implementation for execution policies.
 // Since you're seeing this in the future, you can enable the parallel execution code by uncommenting the following line 
 //#define PARALLEL_ENABLED
+// The tests below PARALLEL_ENABLED use the policies from parallelAlgorithms.h instead, which need no TBB.
 
 #include <iostream>
 #include <chrono>
 #include <string>
 #include <functional>
 #include <numeric>
+#include <random>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "benchmark.h"
+#include "parallelAlgorithms.h"
 
 #ifdef PARALLEL_ENABLED
 #include <execution>
@@ -18,17 +22,8 @@ using namespace std;
 using namespace std::placeholders;
 using namespace std::chrono;
 
-auto measureExecutionTimeForF = [](auto f){
-    auto t1 = high_resolution_clock::now();
-    f();
-    auto t2 = high_resolution_clock::now();
-    chrono::nanoseconds duration = t2 - t1;
-    return duration;
-};
-
 TEST_CASE("Baseline"){
-    auto duration = measureExecutionTimeForF([](){return 1 + 1;});
-    cout << duration.count() << " ns" << endl;
+    printDuration("Baseline: ", [](){return 1 + 1;});
 }
 
 #ifdef PARALLEL_ENABLED
@@ -39,14 +34,110 @@ TEST_CASE("all_of with sequential execution policy"){
         return all_of(execution::seq, aVector.begin(), aVector.end(), [](auto value){return value > 5;});
     };
 
-    auto sequentialDuration = measureExecutionTimeForF(all_of_sequential);
-    cout << "Execution time for sequential policy:" << sequentialDuration.count() << " ns" << endl;
+    printDuration("Execution time for sequential policy: ", all_of_sequential);
 
     auto all_of_parallel = [&aVector](){
         return all_of(execution::par, aVector.begin(), aVector.end(), [](auto value){return value > 5;});
     };
 
-    auto parallelDuration = measureExecutionTimeForF(all_of_parallel);
-    cout << "Execution time for parallel policy:" << parallelDuration.count() << " ns" << endl;
+    printDuration("Execution time for parallel policy: ", all_of_parallel);
 }
 #endif
+
+TEST_CASE("all_of with in-project execution policies"){
+    auto aVector = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    ThreadPool pool(4);
+    parallel::ParallelPolicy par{&pool, 2};
+
+    CHECK(!parallel::all_of(parallel::seq, aVector.begin(), aVector.end(), [](auto value){return value > 5;}));
+    CHECK(!parallel::all_of(par, aVector.begin(), aVector.end(), [](auto value){return value > 5;}));
+    CHECK(parallel::all_of(par, aVector.begin(), aVector.end(), [](auto value){return value > 0;}));
+    CHECK(parallel::any_of(par, aVector.begin(), aVector.end(), [](auto value){return value == 10;}));
+    CHECK(parallel::none_of(par, aVector.begin(), aVector.end(), [](auto value){return value > 10;}));
+}
+
+TEST_CASE("parallel algorithms agree with the sequential ones"){
+    ThreadPool pool(4);
+    parallel::ParallelPolicy par{&pool, 1000};
+    parallel::ParallelUnsequencedPolicy par_unseq;
+    par_unseq.pool = &pool;
+    par_unseq.grain = 1000;
+
+    vector<int> values(100003);
+    mt19937 generator(42);
+    uniform_int_distribution<int> distribution(-1000000, 1000000);
+    generate(values.begin(), values.end(), [&](){ return distribution(generator); });
+    auto increment = [](int value){ return value + 1; };
+    auto isEven = [](int value){ return value % 2 == 0; };
+
+    auto expectedTransformed = transformAllWithPolicy<vector<int>>(parallel::seq, values, increment);
+    CHECK_EQ(expectedTransformed, transformAllWithPolicy<vector<int>>(par, values, increment));
+    CHECK_EQ(expectedTransformed, transformAllWithPolicy<vector<int>>(par_unseq, values, increment));
+    CHECK_EQ(transformAllWithPolicy<vector<bool>>(parallel::seq, values, isEven), transformAllWithPolicy<vector<bool>>(parallel::ParallelPolicy{&pool, 0}, values, isEven));
+
+    CHECK_EQ(accumulateAllWithPolicy(parallel::seq, values, 0LL, plus<long long>()), accumulateAllWithPolicy(par, values, 0LL, plus<long long>()));
+    CHECK_EQ(7, accumulateAllWithPolicy(par, vector<int>{}, 7, plus<int>()));
+
+    vector<int> expectedEven;
+    copy_if(values.begin(), values.end(), back_inserter(expectedEven), isEven);
+    vector<int> even(values.size());
+    even.resize(parallel::copy_if(par, values.begin(), values.end(), even.begin(), isEven) - even.begin());
+    CHECK_EQ(expectedEven, even);
+
+    vector<int> expectedSorted(values);
+    sort(expectedSorted.begin(), expectedSorted.end());
+    vector<int> sorted(values);
+    parallel::sort(par, sorted.begin(), sorted.end());
+    CHECK_EQ(expectedSorted, sorted);
+
+    vector<int> sortedDescending(values);
+    parallel::sort(parallel::ParallelPolicy{&pool, 1300}, sortedDescending.begin(), sortedDescending.end(), greater<int>());
+    CHECK(is_sorted(sortedDescending.begin(), sortedDescending.end(), greater<int>()));
+}
+
+TEST_CASE("parallel algorithms with small grains and failing chunks"){
+    ThreadPool pool(4);
+    vector<int> values(640);
+    iota(values.begin(), values.end(), 0);
+    auto isEven = [](int value){ return value % 2 == 0; };
+
+    SUBCASE("any grain keeps vector<bool> chunks apart"){
+        CHECK_EQ(64, parallel::grainFor(parallel::ParallelPolicy{&pool, 10}, values.size()));
+        CHECK_EQ(128, parallel::grainFor(parallel::ParallelPolicy{&pool, 100}, values.size()));
+        for(size_t grain : {1, 10, 63, 100}){
+            CHECK_EQ(transformAllWithPolicy<vector<bool>>(parallel::seq, values, isEven), transformAllWithPolicy<vector<bool>>(parallel::ParallelPolicy{&pool, grain}, values, isEven));
+        }
+    }
+
+    SUBCASE("a failing chunk is rethrown once every chunk is done"){
+        atomic<size_t> transformed{0};
+        auto failOnFirst = [&transformed](int value){
+            if(value == 0) throw runtime_error("failed");
+            this_thread::sleep_for(microseconds(10));
+            ++transformed;
+            return value;
+        };
+        CHECK_THROWS_AS(transformAllWithPolicy<vector<int>>(parallel::ParallelPolicy{&pool, 64}, values, failOnFirst), runtime_error);
+        CHECK_EQ(values.size() - 64, transformed.load());
+    }
+}
+
+TEST_CASE("all_of sequential vs parallel with large inputs"){
+    vector<int> aVector(10000000);
+    iota(aVector.begin(), aVector.end(), 1);
+    BenchmarkOptions options;
+    options.samples = 11;
+
+    auto all_of_sequential = [&aVector](){
+        return parallel::all_of(parallel::seq, aVector.begin(), aVector.end(), [](auto value){return value > 0;});
+    };
+    auto all_of_parallel = [&aVector](){
+        return parallel::all_of(parallel::par, aVector.begin(), aVector.end(), [](auto value){return value > 0;});
+    };
+
+    printBenchmark(runBenchmark("all_of over 10^7 values, sequential policy: ", all_of_sequential, options));
+    printBenchmark(runBenchmark("all_of over 10^7 values, parallel policy (" + to_string(parallel::defaultThreadPool().size()) + " workers): ", all_of_parallel, options));
+
+    CHECK(all_of_sequential());
+    CHECK(all_of_parallel());
+}
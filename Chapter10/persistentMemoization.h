@@ -0,0 +1,371 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "memoizationCache.h"
+
+using namespace std;
+
+inline uint64_t fnv1a(const unsigned char* bytes, const size_t length, uint64_t seed = 0xcbf29ce484222325ULL){
+    for(size_t i = 0; i < length; ++i){
+        seed ^= bytes[i];
+        seed *= 0x100000001b3ULL;
+    }
+    return seed;
+}
+
+// Memoization cache backed by a memory mapped file, so a new process starts
+// with every result computed by the previous ones.
+//
+// The file is a header followed by a fixed number of records that form an open
+// addressing hash table; lookups probe the mapping directly, there is nothing
+// to parse on startup. A record is written once: key and value bytes first,
+// then a commit word holding their checksum. A record whose commit word is zero
+// was never finished and counts as free; one whose checksum does not match was
+// torn by a crash and is skipped forever. The header stores a signature of the
+// function's types and a caller supplied version, and a file with a different
+// signature is discarded.
+//
+// A file is never resized in place. When the table is three quarters full, the
+// writer copies the records into a new file of twice the size and renames it
+// over the old one, so a mapping never changes size under its readers. Readers
+// in this process never lock: they keep probing the old mapping, which stays
+// mapped until the cache is destroyed, and only miss what was stored since.
+// Writers, in this and other processes, take flock(LOCK_EX) on the file and
+// switch to the new file first if another writer replaced theirs.
+template<typename ReturnType, typename... Args>
+class PersistentMemoizationCache{
+    static_assert(is_trivially_copyable<ReturnType>::value, "persisted results must be trivially copyable");
+    static_assert((is_trivially_copyable<Args>::value && ...), "persisted arguments must be trivially copyable");
+
+    private:
+        struct Header{
+            char magic[8];
+            uint32_t formatVersion;
+            uint32_t recordSize;
+            uint64_t signature;
+            uint64_t recordCount;
+            uint64_t usedRecords;
+        };
+
+        static constexpr char magicValue[8] = {'F', 'C', 'M', 'E', 'M', 'O', '0', '1'};
+        static constexpr uint32_t formatVersion = 1;
+        static constexpr size_t keySize = (sizeof(Args) + ... + 0);
+        static constexpr size_t payloadSize = keySize + sizeof(ReturnType);
+
+    public:
+        static constexpr size_t headerSize = 64;
+        static constexpr size_t recordSize = (sizeof(uint64_t) + payloadSize + 7) / 8 * 8;
+
+    private:
+        typedef tuple<Args...> Key;
+
+        struct Mapping{
+            unsigned char* bytes;
+            size_t size;
+
+            Mapping(unsigned char* bytes, const size_t size) : bytes(bytes), size(size){}
+            Mapping(const Mapping&) = delete;
+            Mapping& operator=(const Mapping&) = delete;
+
+            ~Mapping(){
+                munmap(bytes, size);
+            }
+
+            Header& header() const{
+                return *reinterpret_cast<Header*>(bytes);
+            }
+
+            uint64_t recordCount() const{
+                return header().recordCount;
+            }
+
+            unsigned char* record(const uint64_t index) const{
+                return bytes + headerSize + index * recordSize;
+            }
+        };
+
+        const string path;
+        const uint64_t signature;
+        const uint64_t initialCapacity;
+        int fileDescriptor = -1;
+        atomic<const Mapping*> current{nullptr};
+        vector<unique_ptr<Mapping>> mappings;
+        mutex writeLock;
+
+        static uint64_t* commitWord(unsigned char* aRecord){
+            return reinterpret_cast<uint64_t*>(aRecord);
+        }
+
+        static void serializeKey(const Key& key, unsigned char* destination){
+            apply([&destination](const auto&... argument){
+                ((memcpy(destination, &argument, sizeof(argument)), destination += sizeof(argument)), ...);
+            }, key);
+        }
+
+        static uint64_t checksum(const unsigned char* payload){
+            return fnv1a(payload, payloadSize) | 1;
+        }
+
+        static uint64_t signatureFor(const string& version){
+            const string description = string(typeid(ReturnType(Args...)).name()) + "#" + version;
+            return fnv1a(reinterpret_cast<const unsigned char*>(description.data()), description.size());
+        }
+
+        [[noreturn]] static void fail(const string& operation){
+            throw system_error(errno, generic_category(), operation);
+        }
+
+        static unique_ptr<Mapping> mapFile(const int descriptor, const size_t size){
+            void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+            if(address == MAP_FAILED) fail("mmap");
+            return make_unique<Mapping>(static_cast<unsigned char*>(address), size);
+        }
+
+        bool headerMatches(const Mapping& mapping) const{
+            const Header& existing = mapping.header();
+            return memcmp(existing.magic, magicValue, sizeof(magicValue)) == 0 &&
+                existing.formatVersion == formatVersion &&
+                existing.recordSize == recordSize &&
+                existing.signature == signature &&
+                existing.recordCount > 0 &&
+                mapping.size == headerSize + existing.recordCount * recordSize;
+        }
+
+        void publish(unique_ptr<Mapping> mapping){
+            mappings.push_back(move(mapping));
+            current.store(mappings.back().get(), memory_order_release);
+        }
+
+        // Whether `descriptor` is still the file found at `path`.
+        bool isCurrentFile(const int descriptor) const{
+            struct stat opened, named;
+            if(fstat(descriptor, &opened) != 0) fail("fstat " + path);
+            return stat(path.c_str(), &named) == 0 && named.st_dev == opened.st_dev && named.st_ino == opened.st_ino;
+        }
+
+        // Takes the writers' lock. If another writer replaced the file in the
+        // meantime, switches to the new one, maps it and checks its header.
+        void lockFile(){
+            bool switched = false;
+            while(true){
+                if(flock(fileDescriptor, LOCK_EX) != 0) fail("flock " + path);
+                if(isCurrentFile(fileDescriptor)) break;
+                flock(fileDescriptor, LOCK_UN);
+                const int reopened = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+                if(reopened < 0) fail("open " + path);
+                ::close(fileDescriptor);
+                fileDescriptor = reopened;
+                switched = true;
+            }
+            if(switched || current.load() == nullptr) adoptFile();
+        }
+
+        void unlockFile(){
+            flock(fileDescriptor, LOCK_UN);
+        }
+
+        void adoptFile(){
+            struct stat status;
+            if(fstat(fileDescriptor, &status) != 0) fail("fstat " + path);
+            if(static_cast<size_t>(status.st_size) >= headerSize){
+                unique_ptr<Mapping> mapping = mapFile(fileDescriptor, status.st_size);
+                if(headerMatches(*mapping)){
+                    publish(move(mapping));
+                    return;
+                }
+            }
+            replaceFile(initialCapacity, nullptr);
+        }
+
+        // Builds a complete file next to `path`, holding the records of `from`
+        // if given, then renames it over `path`. The caller holds the lock on
+        // the old file, and the new one is locked before it becomes visible.
+        void replaceFile(const uint64_t capacity, const Mapping* from){
+            const string newPath = path + ".new";
+            const int descriptor = open(newPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if(descriptor < 0) fail("open " + newPath);
+            const size_t size = headerSize + capacity * recordSize;
+            if(ftruncate(descriptor, size) != 0 || flock(descriptor, LOCK_EX) != 0){
+                const int error = errno;
+                ::close(descriptor);
+                throw system_error(error, generic_category(), "ftruncate " + newPath);
+            }
+            unique_ptr<Mapping> mapping;
+            try{
+                mapping = mapFile(descriptor, size);
+            } catch(...){
+                ::close(descriptor);
+                throw;
+            }
+
+            Header& created = mapping->header();
+            memcpy(created.magic, magicValue, sizeof(magicValue));
+            created.formatVersion = formatVersion;
+            created.recordSize = recordSize;
+            created.signature = signature;
+            created.recordCount = capacity;
+            created.usedRecords = 0;
+            if(from != nullptr){
+                for(uint64_t index = 0; index < from->recordCount(); ++index){
+                    unsigned char* aRecord = from->record(index);
+                    const uint64_t commit = __atomic_load_n(commitWord(aRecord), __ATOMIC_ACQUIRE);
+                    if(commit != 0 && commit == checksum(aRecord + sizeof(uint64_t))) insert(*mapping, aRecord + sizeof(uint64_t));
+                }
+            }
+            msync(mapping->bytes, size, MS_SYNC);
+
+            if(rename(newPath.c_str(), path.c_str()) != 0){
+                const int error = errno;
+                ::close(descriptor);
+                throw system_error(error, generic_category(), "rename " + newPath);
+            }
+            // The old mapping keeps the old file open, so closing it would not
+            // release its lock.
+            flock(fileDescriptor, LOCK_UN);
+            ::close(fileDescriptor);
+            fileDescriptor = descriptor;
+            publish(move(mapping));
+        }
+
+        // Returns false when the key was already there.
+        static bool insert(const Mapping& mapping, const unsigned char* payload){
+            Key key;
+            const unsigned char* source = payload;
+            apply([&source](auto&... argument){
+                ((memcpy(&argument, source, sizeof(argument)), source += sizeof(argument)), ...);
+            }, key);
+            const size_t hash = hashTuple(key);
+            const uint64_t recordCount = mapping.recordCount();
+
+            for(uint64_t probe = 0; probe < recordCount; ++probe){
+                unsigned char* aRecord = mapping.record((hash + probe) % recordCount);
+                const uint64_t commit = __atomic_load_n(commitWord(aRecord), __ATOMIC_ACQUIRE);
+                if(commit != 0){
+                    if(memcmp(aRecord + sizeof(uint64_t), payload, keySize) == 0 && commit == checksum(aRecord + sizeof(uint64_t))) return false;
+                    continue;
+                }
+                memcpy(aRecord + sizeof(uint64_t), payload, payloadSize);
+                __atomic_store_n(commitWord(aRecord), checksum(payload), __ATOMIC_RELEASE);
+                ++mapping.header().usedRecords;
+                return true;
+            }
+            throw logic_error("persistent memoization table is full");
+        }
+
+    public:
+        PersistentMemoizationCache(const string& path, const string& version, const uint64_t capacity = 1 << 20) :
+            path(path), signature(signatureFor(version)), initialCapacity(max<uint64_t>(capacity, 1)){
+            fileDescriptor = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if(fileDescriptor < 0) fail("open " + path);
+            try{
+                lockFile();
+            } catch(...){
+                ::close(fileDescriptor);
+                throw;
+            }
+            unlockFile();
+        };
+
+        PersistentMemoizationCache(const PersistentMemoizationCache&) = delete;
+        PersistentMemoizationCache& operator=(const PersistentMemoizationCache&) = delete;
+
+        ~PersistentMemoizationCache(){
+            ::close(fileDescriptor);
+        }
+
+        optional<ReturnType> lookup(const Key& key) const{
+            const Mapping& mapping = *current.load(memory_order_acquire);
+            const uint64_t recordCount = mapping.recordCount();
+            unsigned char keyBytes[keySize + 1];
+            serializeKey(key, keyBytes);
+            const size_t hash = hashTuple(key);
+
+            for(uint64_t probe = 0; probe < recordCount; ++probe){
+                unsigned char* aRecord = mapping.record((hash + probe) % recordCount);
+                const uint64_t commit = __atomic_load_n(commitWord(aRecord), __ATOMIC_ACQUIRE);
+                if(commit == 0) return nullopt;
+                const unsigned char* payload = aRecord + sizeof(uint64_t);
+                if(memcmp(payload, keyBytes, keySize) != 0 || commit != checksum(payload)) continue;
+                ReturnType value;
+                memcpy(&value, payload + keySize, sizeof(ReturnType));
+                return value;
+            }
+            return nullopt;
+        }
+
+        // Grows the file first when it is three quarters full.
+        void store(const Key& key, const ReturnType& value){
+            lock_guard<mutex> guard(writeLock);
+            lockFile();
+            try{
+                const Mapping* mapping = current.load();
+                if(mapping->header().usedRecords * 4 >= mapping->recordCount() * 3){
+                    replaceFile(mapping->recordCount() * 2, mapping);
+                    mapping = current.load();
+                }
+                unsigned char payload[payloadSize];
+                serializeKey(key, payload);
+                memcpy(payload + keySize, &value, sizeof(ReturnType));
+                insert(*mapping, payload);
+            } catch(...){
+                unlockFile();
+                throw;
+            }
+            unlockFile();
+        }
+
+        template<typename F>
+        ReturnType getOrCompute(const Key& key, F compute){
+            optional<ReturnType> cached = lookup(key);
+            if(cached) return *cached;
+            ReturnType result = compute();
+            store(key, result);
+            return result;
+        }
+
+        // Forces the records to disk; without it they survive a process crash
+        // through the page cache but not a machine crash.
+        void sync(){
+            const Mapping& mapping = *current.load(memory_order_acquire);
+            if(msync(mapping.bytes, mapping.size, MS_SYNC) != 0) fail("msync");
+        }
+
+        uint64_t size() const{
+            return current.load(memory_order_acquire)->header().usedRecords;
+        }
+
+        uint64_t capacity() const{
+            return current.load(memory_order_acquire)->recordCount();
+        }
+};
+
+template<typename ReturnType, typename... Args>
+function<ReturnType(Args...)> memoizePersistent(function<ReturnType(Args...)> f, shared_ptr<PersistentMemoizationCache<ReturnType, Args...>> cache){
+    return [f, cache](Args... args){
+        return cache->getOrCompute(tuple<Args...>(args...), [&](){ return f(args...); });
+    };
+};
+
+template<typename ReturnType, typename... Args>
+function<ReturnType(Args...)> memoizePersistent(function<ReturnType(Args...)> f, const string& path, const string& version){
+    return memoizePersistent(f, make_shared<PersistentMemoizationCache<ReturnType, Args...>>(path, version));
+};
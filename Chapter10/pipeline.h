@@ -0,0 +1,120 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Lazy transform pipelines: source | fused::map(f) | fused::filter(p) | fused::into(destination).
+// Stages only compose functions; nothing runs until the sink, which walks the
+// source once and pushes every element through all stages. An rvalue source
+// whose element type survives the pipeline is reused as the result buffer.
+namespace fused{
+    template<typename F>
+    struct MapStage{ F f; };
+
+    template<typename Predicate>
+    struct FilterStage{ Predicate predicate; };
+
+    template<typename Destination>
+    struct IntoSink{ Destination& destination; };
+
+    struct CollectSink{};
+
+    template<typename F>
+    MapStage<F> map(F f){ return {f}; }
+
+    template<typename Predicate>
+    FilterStage<Predicate> filter(Predicate predicate){ return {predicate}; }
+
+    template<typename Destination>
+    IntoSink<Destination> into(Destination& destination){ return {destination}; }
+
+    inline CollectSink collect(){ return {}; }
+
+    // `step(value, emit)` calls emit zero or one times with the value after all
+    // stages. Without filters every element comes out, so sinks can write by
+    // index instead of appending, which lets the compiler vectorize the loop.
+    template<typename Source, typename Element, typename Step, bool HasFilter>
+    struct Pipeline{
+        Source source;
+        Step step;
+    };
+
+    struct Identity{
+        template<typename T, typename Emit>
+        void operator()(const T& value, Emit&& emit) const{ emit(value); }
+    };
+
+    template<typename Container>
+    using ElementOf = typename decay_t<Container>::value_type;
+
+    // Lvalue sources are referenced, rvalue sources are moved into the pipeline.
+    template<typename Container>
+    using SourceHolder = conditional_t<is_lvalue_reference<Container>::value, Container, decay_t<Container>>;
+
+    template<typename Source, typename Element, typename Step, bool HasFilter, typename F>
+    auto operator|(Pipeline<Source, Element, Step, HasFilter>&& pipeline, MapStage<F> stage){
+        auto step = [previous = pipeline.step, f = stage.f](const auto& value, auto&& emit){
+            previous(value, [&](const auto& intermediate){ emit(f(intermediate)); });
+        };
+        typedef decay_t<invoke_result_t<F&, const Element&>> Result;
+        return Pipeline<Source, Result, decltype(step), HasFilter>{std::forward<Source>(pipeline.source), step};
+    }
+
+    template<typename Source, typename Element, typename Step, bool HasFilter, typename Predicate>
+    auto operator|(Pipeline<Source, Element, Step, HasFilter>&& pipeline, FilterStage<Predicate> stage){
+        auto step = [previous = pipeline.step, predicate = stage.predicate](const auto& value, auto&& emit){
+            previous(value, [&](const auto& intermediate){ if(predicate(intermediate)) emit(intermediate); });
+        };
+        return Pipeline<Source, Element, decltype(step), true>{std::forward<Source>(pipeline.source), step};
+    }
+
+    template<typename Container, typename Stage, typename = ElementOf<Container>>
+    auto operator|(Container&& source, Stage stage){
+        typedef ElementOf<Container> Element;
+        return Pipeline<SourceHolder<Container&&>, Element, Identity, false>{std::forward<Container>(source), Identity()} | stage;
+    }
+
+    template<typename Source, typename Element, typename Step, bool HasFilter, typename Output>
+    size_t run(Source& source, const Step& step, Output* output){
+        const auto* input = source.data();
+        const size_t size = source.size();
+        if constexpr(!HasFilter){
+            for(size_t i = 0; i < size; ++i){
+                step(input[i], [&](const Element& result){ output[i] = result; });
+            }
+            return size;
+        } else {
+            size_t written = 0;
+            for(size_t i = 0; i < size; ++i){
+                const auto value = input[i];
+                step(value, [&](const Element& result){ output[written++] = result; });
+            }
+            return written;
+        }
+    }
+
+    template<typename Source, typename Element, typename Step, bool HasFilter, typename Destination>
+    Destination& operator|(Pipeline<Source, Element, Step, HasFilter>&& pipeline, IntoSink<Destination> sink){
+        Destination& destination = sink.destination;
+        destination.resize(pipeline.source.size());
+        destination.resize(run<Source, Element, Step, HasFilter>(pipeline.source, pipeline.step, destination.data()));
+        return destination;
+    }
+
+    // Writes back into an owned source of the same element type: with at most
+    // one output per input, the write position never passes the read position.
+    template<typename Source, typename Element, typename Step, bool HasFilter>
+    vector<Element> operator|(Pipeline<Source, Element, Step, HasFilter>&& pipeline, CollectSink){
+        if constexpr(!is_reference<Source>::value && is_same<Source, vector<Element>>::value){
+            vector<Element> result(std::move(pipeline.source));
+            result.resize(run<vector<Element>, Element, Step, HasFilter>(result, pipeline.step, result.data()));
+            return result;
+        } else {
+            vector<Element> result;
+            return std::move(pipeline) | into(result);
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Trial division by 2, 3, 5 and then only by numbers coprime to 30.
+inline bool isPrimeWheel(const uint64_t n){
+    if(n < 2) return false;
+    for(uint64_t prime : {2, 3, 5}){
+        if(n % prime == 0) return n == prime;
+    }
+    static const uint64_t gaps[] = {4, 2, 4, 2, 4, 6, 2, 6};
+    uint64_t candidate = 7;
+    for(size_t gap = 0; candidate * candidate <= n; candidate += gaps[gap], gap = (gap + 1) % 8){
+        if(n % candidate == 0) return false;
+    }
+    return true;
+}
+
+inline uint64_t multiplyModulo(const uint64_t a, const uint64_t b, const uint64_t modulus){
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(a) * b % modulus);
+}
+
+inline uint64_t powerModulo(uint64_t base, uint64_t exponent, const uint64_t modulus){
+    uint64_t result = 1;
+    base %= modulus;
+    while(exponent > 0){
+        if(exponent & 1) result = multiplyModulo(result, base, modulus);
+        base = multiplyModulo(base, base, modulus);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+// Deterministic Miller-Rabin: bases 2, 7, 61 decide every n < 4,759,123,141,
+// the first twelve primes decide every 64 bit n.
+inline bool isPrimeMillerRabin(const uint64_t n){
+    if(n < 2) return false;
+    for(uint64_t prime : {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37}){
+        if(n % prime == 0) return n == prime;
+    }
+
+    uint64_t oddPart = n - 1;
+    int twos = 0;
+    while((oddPart & 1) == 0){
+        oddPart >>= 1;
+        ++twos;
+    }
+
+    auto isWitness = [&](const uint64_t base){
+        // A base that is a multiple of n proves nothing; 61 is the only one.
+        if(base % n == 0) return false;
+        uint64_t x = powerModulo(base, oddPart, n);
+        if(x == 1 || x == n - 1) return false;
+        for(int i = 1; i < twos; ++i){
+            x = multiplyModulo(x, x, n);
+            if(x == n - 1) return false;
+        }
+        return true;
+    };
+
+    static const vector<uint64_t> smallBases{2, 7, 61};
+    static const vector<uint64_t> allBases{2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    const auto& bases = (n < 4759123141ULL) ? smallBases : allBases;
+    return none_of(bases.begin(), bases.end(), isWitness);
+}
+
+// Wheel division is cheaper while sqrt(n) is small, Miller-Rabin past that.
+inline bool isPrime(const long long n){
+    if(n < 2) return false;
+    return (n < (1 << 20)) ? isPrimeWheel(n) : isPrimeMillerRabin(n);
+}
+
+inline vector<int> smallPrimesUpTo(const int limit){
+    vector<char> composite(limit + 1, 0);
+    vector<int> primes;
+    for(int value = 2; value <= limit; ++value){
+        if(composite[value]) continue;
+        primes.push_back(value);
+        for(long long multiple = static_cast<long long>(value) * value; multiple <= limit; multiple += value) composite[multiple] = 1;
+    }
+    return primes;
+}
+
+// Segmented Sieve of Eratosthenes over [low, high]. Segments fit in L1, so every
+// base prime crosses out its multiples in a block that stays in cache.
+// Element i tells whether low + i is prime.
+inline vector<bool> sieveRange(long long low, const long long high, const long long segmentSize = 32768){
+    if(high < low) return {};
+    vector<bool> result(high - low + 1, false);
+    const long long start = max(low, 2LL);
+    if(high < start) return result;
+
+    const vector<int> basePrimes = smallPrimesUpTo(static_cast<int>(sqrt(static_cast<double>(high))) + 1);
+    vector<char> segment(segmentSize);
+    for(long long segmentLow = start; segmentLow <= high; segmentLow += segmentSize){
+        const long long segmentHigh = min(high, segmentLow + segmentSize - 1);
+        fill(segment.begin(), segment.end(), 1);
+        for(const long long prime : basePrimes){
+            if(prime * prime > segmentHigh) break;
+            long long multiple = max(prime * prime, (segmentLow + prime - 1) / prime * prime);
+            for(; multiple <= segmentHigh; multiple += prime) segment[multiple - segmentLow] = 0;
+        }
+        for(long long value = segmentLow; value <= segmentHigh; ++value){
+            result[value - low] = segment[value - segmentLow];
+        }
+    }
+    return result;
+}
+
+// Batch predicate: sieves the span of the values when they are dense enough
+// for that to beat testing each of them.
+inline vector<bool> arePrimes(const vector<int>& values){
+    vector<bool> results(values.size(), false);
+    if(values.empty()) return results;
+
+    const auto [smallest, largest] = minmax_element(values.begin(), values.end());
+    const long long span = static_cast<long long>(*largest) - *smallest + 1;
+    if(span <= 16 * static_cast<long long>(values.size())){
+        const vector<bool> sieved = sieveRange(*smallest, *largest);
+        for(size_t i = 0; i < values.size(); ++i) results[i] = sieved[values[i] - *smallest];
+    } else {
+        for(size_t i = 0; i < values.size(); ++i) results[i] = isPrime(values[i]);
+    }
+    return results;
+}
@@ -1,57 +1,64 @@
 #include <iostream>
 #include <algorithm>
+#include <charconv>
 #include <chrono>
 #include <string>
+#include <cstring>
 #include <functional>
 #include <numeric>
-#include <future>
+#include "primes.h"
+#include "reactivePipeline.h"
 
 using namespace std;
 using namespace std::placeholders;
 using namespace std::chrono;
 
-template<typename DestinationType>
-auto transformAll = [](const auto& source, const auto& fn){
-    DestinationType result(source.size());
-    transform(source.begin(), source.end(), result.begin(), fn);
-    return result;
+auto is_prime = [](const long long x) {
+    return isPrime(x);
 };
 
-auto rangeFromTo = [](const int start, const int end){
-    vector<int> aVector(end - start + 1);
-    iota(aVector.begin(), aVector.end(), start);
-    return aVector;
+auto appendIsPrime = [](const long long value, string& text){
+    char digits[24];
+    auto end = to_chars(digits, digits + sizeof(digits), value).ptr;
+    text.append(digits, end);
+    text.append(is_prime(value) ? " is prime\n" : " is not prime\n");
 };
 
-auto rangeFrom1To = bind(rangeFromTo, 1, _1);
-
-auto rangeFrom2To = bind(rangeFromTo, 2, _1);
-
-auto isDivisibleBy = [](const int value, const int factor){
-    return (value % factor == 0); 
-};
-
-auto none_of_collection = [](const auto& aCollection, const auto& fn){
-    return none_of(aCollection.begin(), aCollection.end(), fn);
-};
-
-auto is_prime = [](const int x) {
-    auto xIsDivisibleBy = bind(isDivisibleBy, x, _1);
-    return none_of_collection(
-            rangeFrom2To(x - 1), 
-            xIsDivisibleBy
-        );
+// Leaves `count` as it was unless all of `text` is a positive number.
+auto parseCount = [](const string& option, const char* text, size_t& count){
+    size_t parsed = 0;
+    const char* end = text + strlen(text);
+    const auto [stop, error] = from_chars(text, end, parsed);
+    if(error != errc() || stop != end || parsed == 0){
+        cerr << "Ignoring " << option << " " << text << ", expected a positive number" << endl;
+        return;
+    }
+    count = parsed;
 };
 
-auto printIsPrime = [](const int value){
-    cout << value << (is_prime(value) ? " is prime" : " is not prime") << endl;
+auto parseOptions = [](int argc, char* argv[]){
+    PipelineOptions options;
+    for(int i = 1; i < argc; ++i){
+        const string argument(argv[i]);
+        const bool hasValue = (i + 1 < argc);
+        if(argument == "--unordered") options.ordered = false;
+        else if(argument == "--workers" && hasValue) parseCount(argument, argv[++i], options.workers);
+        else if(argument == "--batch" && hasValue) parseCount(argument, argv[++i], options.batchSize);
+        else if(argument == "--queue" && hasValue) parseCount(argument, argv[++i], options.queueCapacity);
+        else cerr << "Ignoring unknown option " << argument << endl;
+    }
+    return options;
 };
 
-int main(){
-    int number;
+int main(int argc, char* argv[]){
+    const PipelineOptions options = parseOptions(argc, argv);
+    const PipelineStatistics statistics = runReactivePipeline(stdin, stdout, options, appendIsPrime);
 
-    while(true){
-        cin >> number;
-        async(printIsPrime, number);
-    }
+    cerr << statistics.numbers << " numbers in " << statistics.batches << " batches, "
+        << duration_cast<milliseconds>(statistics.elapsed).count() << " ms, "
+        << static_cast<long long>(statistics.numbersPerSecond()) << " numbers/s, batch latency p50 "
+        << duration_cast<microseconds>(statistics.latencyPercentile(50)).count() << " us, p99 "
+        << duration_cast<microseconds>(statistics.latencyPercentile(99)).count() << " us ("
+        << options.workers << " workers, " << (options.ordered ? "ordered" : "unordered") << ")" << endl;
+    if(statistics.tooLarge > 0) cerr << statistics.tooLarge << " numbers too large for a long long were skipped" << endl;
 }
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <climits>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Multi producer, multi consumer queue with a fixed capacity. push() blocks while
+// the queue is full, which is what slows a fast producer down to the pace of
+// its consumers. After close(), pop() drains what is left and then returns nullopt.
+template<typename T>
+class BoundedQueue{
+    private:
+        const size_t capacity;
+        deque<T> items;
+        bool closed = false;
+        mutex lock;
+        condition_variable notFull;
+        condition_variable notEmpty;
+
+    public:
+        explicit BoundedQueue(const size_t capacity) : capacity(max<size_t>(capacity, 1)){};
+
+        void push(T item){
+            unique_lock<mutex> guard(lock);
+            notFull.wait(guard, [this](){ return items.size() < capacity || closed; });
+            if(closed) return;
+            items.push_back(move(item));
+            guard.unlock();
+            notEmpty.notify_one();
+        }
+
+        optional<T> pop(){
+            unique_lock<mutex> guard(lock);
+            notEmpty.wait(guard, [this](){ return !items.empty() || closed; });
+            if(items.empty()) return nullopt;
+            T item = move(items.front());
+            items.pop_front();
+            guard.unlock();
+            notFull.notify_one();
+            return item;
+        }
+
+        void close(){
+            {
+                lock_guard<mutex> guard(lock);
+                closed = true;
+            }
+            notFull.notify_all();
+            notEmpty.notify_all();
+        }
+};
+
+// queueCapacity bounds both queues and, in ordered mode, how many batches may
+// wait in the writer for an earlier one.
+struct PipelineOptions{
+    size_t workers = max(1u, thread::hardware_concurrency());
+    size_t batchSize = 4096;
+    size_t queueCapacity = 64;
+    bool ordered = true;
+};
+
+struct PipelineStatistics{
+    size_t numbers = 0;
+    size_t tooLarge = 0;
+    size_t batches = 0;
+    nanoseconds elapsed{0};
+    vector<nanoseconds> batchLatencies;
+
+    double numbersPerSecond() const{
+        return (elapsed.count() == 0) ? 0 : numbers * 1e9 / elapsed.count();
+    }
+
+    nanoseconds latencyPercentile(const double percentile) const{
+        if(batchLatencies.empty()) return nanoseconds(0);
+        vector<nanoseconds> sorted(batchLatencies);
+        sort(sorted.begin(), sorted.end());
+        const size_t rank = min(sorted.size() - 1, static_cast<size_t>(percentile / 100.0 * sorted.size()));
+        return sorted[rank];
+    }
+};
+
+struct InputBatch{
+    size_t sequence;
+    vector<long long> numbers;
+    steady_clock::time_point readAt;
+};
+
+struct OutputBatch{
+    size_t sequence;
+    string text;
+    steady_clock::time_point readAt;
+};
+
+// Sequence numbers the workers may hand to an ordered writer: a batch more than
+// `limit` ahead of the next one to write waits, so the writer never holds more
+// than `limit` batches back. The next batch itself never waits.
+class ReorderWindow{
+    private:
+        const size_t limit;
+        size_t next = 0;
+        mutex lock;
+        condition_variable advanced;
+
+    public:
+        explicit ReorderWindow(const size_t limit) : limit(max<size_t>(limit, 1)){};
+
+        void waitFor(const size_t sequence){
+            unique_lock<mutex> guard(lock);
+            advanced.wait(guard, [&](){ return sequence < next + limit; });
+        }
+
+        void advanceTo(const size_t sequence){
+            {
+                lock_guard<mutex> guard(lock);
+                next = sequence;
+            }
+            advanced.notify_all();
+        }
+};
+
+// Reads whitespace separated integers with large fread calls and hands them out
+// in batches, and returns how many it read. Anything that is not a digit or a
+// leading minus separates numbers. Numbers that do not fit in a long long are
+// dropped and counted in `tooLarge`.
+inline size_t readBatches(FILE* input, BoundedQueue<InputBatch>& batches, const size_t batchSize, size_t& tooLarge){
+    vector<char> buffer(1 << 16);
+    InputBatch batch{0, {}, steady_clock::now()};
+    batch.numbers.reserve(batchSize);
+    long long value = 0;
+    bool negative = false;
+    bool inNumber = false;
+    bool overflowed = false;
+    size_t sequence = 0;
+
+    auto emit = [&](){
+        batch.sequence = sequence++;
+        batch.readAt = steady_clock::now();
+        batches.push(move(batch));
+        batch = InputBatch{0, {}, steady_clock::now()};
+        batch.numbers.reserve(batchSize);
+    };
+
+    size_t bytesRead;
+    while((bytesRead = fread(buffer.data(), 1, buffer.size(), input)) > 0){
+        for(size_t i = 0; i < bytesRead; ++i){
+            const char character = buffer[i];
+            if(character >= '0' && character <= '9'){
+                const int digit = character - '0';
+                if(value > (LLONG_MAX - digit) / 10) overflowed = true;
+                else value = value * 10 + digit;
+                inNumber = true;
+            } else if(character == '-' && !inNumber){
+                negative = true;
+            } else {
+                if(inNumber && overflowed){
+                    ++tooLarge;
+                } else if(inNumber){
+                    batch.numbers.push_back(negative ? -value : value);
+                    if(batch.numbers.size() == batchSize) emit();
+                }
+                value = 0;
+                negative = false;
+                inNumber = false;
+                overflowed = false;
+            }
+        }
+    }
+    if(inNumber && overflowed) ++tooLarge;
+    else if(inNumber) batch.numbers.push_back(negative ? -value : value);
+    const size_t count = sequence * batchSize + batch.numbers.size();
+    if(!batch.numbers.empty()) emit();
+    return count;
+}
+
+// Reader -> bounded queue -> worker threads -> bounded queue -> writer.
+// `format(number, text)` appends the output for one number to `text`. In ordered
+// mode the writer holds early batches back until the ones before them are out.
+template<typename Format>
+PipelineStatistics runReactivePipeline(FILE* input, FILE* output, const PipelineOptions& options, Format format){
+    BoundedQueue<InputBatch> inputBatches(options.queueCapacity);
+    BoundedQueue<OutputBatch> outputBatches(options.queueCapacity);
+    ReorderWindow window(options.queueCapacity);
+    PipelineStatistics statistics;
+    const auto start = steady_clock::now();
+
+    vector<thread> workers;
+    for(size_t i = 0; i < max<size_t>(options.workers, 1); ++i){
+        workers.emplace_back([&](){
+            while(auto batch = inputBatches.pop()){
+                OutputBatch result{batch->sequence, string(), batch->readAt};
+                result.text.reserve(batch->numbers.size() * 24);
+                for(const long long number : batch->numbers) format(number, result.text);
+                if(options.ordered) window.waitFor(result.sequence);
+                outputBatches.push(move(result));
+            }
+        });
+    }
+
+    thread writer([&](){
+        map<size_t, OutputBatch> waiting;
+        size_t nextSequence = 0;
+        auto write = [&](const OutputBatch& batch){
+            fwrite(batch.text.data(), 1, batch.text.size(), output);
+            statistics.batchLatencies.push_back(steady_clock::now() - batch.readAt);
+        };
+
+        while(auto batch = outputBatches.pop()){
+            if(!options.ordered){
+                write(*batch);
+                continue;
+            }
+            waiting.emplace(batch->sequence, move(*batch));
+            for(auto next = waiting.find(nextSequence); next != waiting.end(); next = waiting.find(++nextSequence)){
+                write(next->second);
+                waiting.erase(next);
+            }
+            window.advanceTo(nextSequence);
+        }
+        fflush(output);
+    });
+
+    statistics.numbers = readBatches(input, inputBatches, options.batchSize, statistics.tooLarge);
+    inputBatches.close();
+    for(auto& worker : workers) worker.join();
+    outputBatches.close();
+    writer.join();
+
+    statistics.elapsed = steady_clock::now() - start;
+    statistics.batches = statistics.batchLatencies.size();
+    return statistics;
+}
@@ -5,24 +5,13 @@
 #include <numeric>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "benchmark.h"
+#include "trampoline.h"
 
 using namespace std;
 using namespace std::placeholders;
 using namespace std::chrono;
 
-auto measureExecutionTimeForF = [](auto f){
-    auto t1 = high_resolution_clock::now();
-    f();
-    auto t2 = high_resolution_clock::now();
-    chrono::nanoseconds duration = t2 - t1;
-    return duration;
-};
-
-auto printDuration = [](string message, auto f){
-    auto duration = measureExecutionTimeForF(f);
-    cout << message  << duration.count() << " ns" << endl;
-};
-
 TEST_CASE("Factorial"){
     function<int(int)> fact = [&fact](int n){
         return (n == 0) ? 1 : (n * fact(n-1));
@@ -55,3 +44,98 @@ TEST_CASE("Double recursion"){
     printDuration("Duration for f1(7): ", [&](){return f1(7);});
     printDuration("Duration for f1(8): ", [&](){return f1(8);});
 }
+
+const unsigned long long primeModulus = 1000000007ULL;
+
+typedef Trampoline<unsigned long long, unsigned long long, unsigned long long> FactorialTrampoline;
+
+auto factorialStep = [](const unsigned long long n, const unsigned long long accumulator){
+    return (n <= 1) ? FactorialTrampoline::done(accumulator) : FactorialTrampoline::call(n - 1, n * accumulator % primeModulus);
+};
+
+auto factorialModuloLoop = [](const unsigned long long n){
+    unsigned long long result = 1;
+    for(unsigned long long value = 2; value <= n; ++value) result = result * value % primeModulus;
+    return result;
+};
+
+typedef Trampoline<bool, unsigned long long> ParityTrampoline;
+
+auto isEvenStep = [](const unsigned long long n){
+    return (n == 0) ? ParityTrampoline::done(true) : ParityTrampoline::callFunction(1, n - 1);
+};
+
+auto isOddStep = [](const unsigned long long n){
+    return (n == 0) ? ParityTrampoline::done(false) : ParityTrampoline::callFunction(0, n - 1);
+};
+
+// f1 and f2 from "Double recursion" with accumulators: each step carries
+// f1(k - 1) and f1(k) up to k = n, which turns the tree recursion into a tail
+// call. f2(k) = f1(k) + f1(k - 1), and f1(k + 1) = (k + 1) * f2(k).
+typedef Trampoline<unsigned long long, unsigned long long, unsigned long long, unsigned long long, unsigned long long> DoubleRecursionTrampoline;
+
+auto f1Step = [](const unsigned long long n, const unsigned long long k, const unsigned long long f1Previous, const unsigned long long f1Current){
+    if(k == n) return DoubleRecursionTrampoline::done(f1Current);
+    const unsigned long long f2Current = (k == 0) ? 2 : (f1Current + f1Previous) % primeModulus;
+    return DoubleRecursionTrampoline::call(n, k + 1, f1Current, (k + 1) * f2Current % primeModulus);
+};
+
+auto f1Trampolined = [](const unsigned long long n){
+    return DoubleRecursionTrampoline::run(f1Step, n, 0, 0, 1);
+};
+
+TEST_CASE("Trampolined factorial"){
+    CHECK_EQ(1, FactorialTrampoline::run(factorialStep, 0, 1));
+    CHECK_EQ(1, FactorialTrampoline::run(factorialStep, 1, 1));
+    CHECK_EQ(3628800, FactorialTrampoline::run(factorialStep, 10, 1));
+    CHECK_EQ(factorialModuloLoop(1024), FactorialTrampoline::run(factorialStep, 1024, 1));
+    CHECK_EQ(factorialModuloLoop(1000000), FactorialTrampoline::run(factorialStep, 1000000, 1));
+}
+
+TEST_CASE("Trampolined mutual recursion"){
+    auto parity = make_tuple(isEvenStep, isOddStep);
+
+    CHECK(ParityTrampoline::run(parity, 0, 0));
+    CHECK(!ParityTrampoline::run(parity, 0, 7));
+    CHECK(ParityTrampoline::run(parity, 1, 7));
+    CHECK(ParityTrampoline::run(parity, 0, 1000000));
+    CHECK(ParityTrampoline::run(parity, 1, 10000001));
+}
+
+TEST_CASE("Trampolined double recursion"){
+    function<int(int)> f2;
+    function<int(int)> f1 = [&f2](int n){
+        return (n == 0) ? 1 : (n * f2(n-1));
+    };
+
+    f2 = [&f1](int n){
+        return (n == 0) ? 2 : (f1(n) + f1(n-1));
+    };
+
+    for(int n = 0; n <= 8; ++n){
+        CHECK_EQ(f1(n), f1Trampolined(n));
+    }
+    CHECK_LT(f1Trampolined(1000000), primeModulus);
+}
+
+TEST_CASE("Trampoline vs recursion benchmark"){
+    BenchmarkOptions options;
+    options.warmupRuns = 1;
+    options.samples = 5;
+
+    function<unsigned long long(unsigned long long, unsigned long long)> recursiveFactorial =
+        [&recursiveFactorial](const unsigned long long n, const unsigned long long accumulator){
+            return (n <= 1) ? accumulator : recursiveFactorial(n - 1, n * accumulator % primeModulus);
+        };
+
+    // Without optimizations even this accumulator version of std::function
+    // recursion takes one stack frame per call, so it only runs at small depths.
+    printBenchmark(runBenchmark("std::function recursion, depth 10^4: ", [&](){ return recursiveFactorial(10000, 1); }, options));
+    printBenchmark(runBenchmark("trampoline, depth 10^4: ", [&](){ return FactorialTrampoline::run(factorialStep, 10000, 1); }, options));
+    printBenchmark(runBenchmark("trampoline, depth 10^6: ", [&](){ return FactorialTrampoline::run(factorialStep, 1000000, 1); }, options));
+    printBenchmark(runBenchmark("loop, depth 10^6: ", [&](){ return factorialModuloLoop(1000000); }, options));
+    printBenchmark(runBenchmark("trampolined f1, depth 10^6: ", [&](){ return f1Trampolined(1000000); }, options));
+    printBenchmark(runBenchmark("trampolined mutual parity, depth 10^6: ", [&](){
+        return ParityTrampoline::run(make_tuple(isEvenStep, isOddStep), 0, 1000000);
+    }, options));
+}
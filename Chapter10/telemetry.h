@@ -0,0 +1,355 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "benchmark.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// In process memory and thread telemetry. Replaces the global operator new and
+// delete, so include it from the single translation unit of a program.
+namespace telemetry{
+    struct AllocationCounters{
+        atomic<uint64_t> allocations{0};
+        atomic<uint64_t> deallocations{0};
+        atomic<uint64_t> bytesAllocated{0};
+        atomic<uint64_t> bytesFreed{0};
+        atomic<uint64_t> liveBytes{0};
+        atomic<uint64_t> peakLiveBytes{0};
+    };
+
+    // Constant initialized, so it is usable by allocations made before main.
+    inline AllocationCounters allocationCounters;
+
+    // The peak of live bytes of every open region, on any thread, one slot per
+    // region. A bit of openPeakSlots is set while its slot is in use.
+    constexpr size_t maxOpenRegions = 64;
+    inline array<atomic<uint64_t>, maxOpenRegions> regionPeakLiveBytes{};
+    inline atomic<uint64_t> openPeakSlots{0};
+
+    inline void raiseTo(atomic<uint64_t>& peak, const uint64_t value){
+        uint64_t current = peak.load(memory_order_relaxed);
+        while(value > current && !peak.compare_exchange_weak(current, value, memory_order_relaxed)){}
+    }
+
+    inline void recordAllocation(const size_t size){
+        allocationCounters.allocations.fetch_add(1, memory_order_relaxed);
+        allocationCounters.bytesAllocated.fetch_add(size, memory_order_relaxed);
+        const uint64_t live = allocationCounters.liveBytes.fetch_add(size, memory_order_relaxed) + size;
+        raiseTo(allocationCounters.peakLiveBytes, live);
+        for(uint64_t open = openPeakSlots.load(memory_order_relaxed); open != 0; open &= open - 1){
+            raiseTo(regionPeakLiveBytes[__builtin_ctzll(open)], live);
+        }
+    }
+
+    // Claims a slot whose peak starts at the current live bytes.
+    inline size_t openPeakSlot(){
+        uint64_t open = openPeakSlots.load();
+        while(true){
+            if(open == ~uint64_t(0)) throw runtime_error("more than " + to_string(maxOpenRegions) + " telemetry regions open");
+            const size_t slot = __builtin_ctzll(~open);
+            regionPeakLiveBytes[slot].store(allocationCounters.liveBytes.load());
+            if(openPeakSlots.compare_exchange_weak(open, open | (uint64_t(1) << slot))) return slot;
+        }
+    }
+
+    inline uint64_t closePeakSlot(const size_t slot){
+        const uint64_t peak = max(regionPeakLiveBytes[slot].load(), allocationCounters.liveBytes.load());
+        openPeakSlots.fetch_and(~(uint64_t(1) << slot));
+        return peak;
+    }
+
+    inline void recordDeallocation(const size_t size){
+        allocationCounters.deallocations.fetch_add(1, memory_order_relaxed);
+        allocationCounters.bytesFreed.fetch_add(size, memory_order_relaxed);
+        allocationCounters.liveBytes.fetch_sub(size, memory_order_relaxed);
+    }
+
+    // Every block starts with a header at least as large as its alignment; the
+    // requested size sits in the last word of the header, right before the pointer
+    // handed out, so delete knows how many bytes it frees.
+    inline size_t headerSizeFor(const size_t alignment){
+        return max(alignment, static_cast<size_t>(__STDCPP_DEFAULT_NEW_ALIGNMENT__));
+    }
+
+    inline void* allocate(const size_t size, const size_t alignment){
+        const size_t headerSize = headerSizeFor(alignment);
+        void* block = nullptr;
+        if(alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__){
+            block = aligned_alloc(alignment, (headerSize + size + alignment - 1) / alignment * alignment);
+        } else {
+            block = malloc(headerSize + size);
+        }
+        if(block == nullptr) return nullptr;
+        char* pointer = static_cast<char*>(block) + headerSize;
+        reinterpret_cast<size_t*>(pointer)[-1] = size;
+        recordAllocation(size);
+        return pointer;
+    }
+
+    inline void* allocateOrThrow(const size_t size, const size_t alignment){
+        while(true){
+            if(void* pointer = allocate(size, alignment)) return pointer;
+            new_handler handler = get_new_handler();
+            if(handler == nullptr) throw bad_alloc();
+            handler();
+        }
+    }
+
+    inline void deallocate(void* pointer, const size_t alignment){
+        if(pointer == nullptr) return;
+        recordDeallocation(reinterpret_cast<size_t*>(pointer)[-1]);
+        free(static_cast<char*>(pointer) - headerSizeFor(alignment));
+    }
+
+    struct ProcessStatus{
+        uint64_t residentKB = 0;
+        uint64_t peakResidentKB = 0;
+        uint64_t threads = 0;
+    };
+
+    // Parses /proc/self/status with plain read(2) into a stack buffer: the
+    // sampler thread must not allocate, or it would show up in the counters.
+    inline ProcessStatus readProcessStatus(){
+        ProcessStatus status;
+        char buffer[4096];
+        const int file = open("/proc/self/status", O_RDONLY | O_CLOEXEC);
+        if(file < 0) return status;
+        const ssize_t length = read(file, buffer, sizeof(buffer) - 1);
+        close(file);
+        if(length <= 0) return status;
+        buffer[length] = '\0';
+
+        auto field = [&buffer](const char* name) -> uint64_t{
+            const char* line = strstr(buffer, name);
+            return (line == nullptr) ? 0 : strtoull(line + strlen(name), nullptr, 10);
+        };
+        status.residentKB = field("VmRSS:");
+        status.peakResidentKB = field("VmHWM:");
+        status.threads = field("Threads:");
+        return status;
+    }
+
+    // Writing 5 to clear_refs resets VmHWM to the current RSS. Without the
+    // permission to do so, region peaks fall back to the sampled RSS.
+    inline bool resetPeakResident(){
+        const int file = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+        if(file < 0) return false;
+        const bool reset = write(file, "5", 1) == 1;
+        close(file);
+        return reset;
+    }
+
+    struct RegionRecord{
+        string name;
+        size_t depth;
+        nanoseconds start;
+        nanoseconds duration;
+        uint64_t allocations;
+        uint64_t deallocations;
+        uint64_t bytesAllocated;
+        uint64_t bytesFreed;
+        uint64_t liveBytesStart;
+        uint64_t peakLiveBytes;
+        uint64_t residentStartKB;
+        uint64_t residentEndKB;
+        uint64_t peakResidentKB;
+        uint64_t threadsStart;
+        uint64_t threadsEnd;
+        uint64_t peakThreads;
+        size_t samples;
+    };
+
+    // Collects finished regions and, when TELEMETRY_TRACE names a file, writes them
+    // there at exit in the Chrome trace event format (chrome://tracing, Perfetto).
+    // Nesting depth is written as the thread id, which gives every level its own track.
+    class Trace{
+        private:
+            mutex lock;
+            vector<RegionRecord> records;
+            const steady_clock::time_point origin = steady_clock::now();
+
+        public:
+            ~Trace(){
+                if(const char* path = getenv("TELEMETRY_TRACE")) write(path);
+            }
+
+            nanoseconds sinceStart() const{
+                return steady_clock::now() - origin;
+            }
+
+            void add(RegionRecord record){
+                lock_guard<mutex> guard(lock);
+                records.push_back(move(record));
+            }
+
+            vector<RegionRecord> snapshot(){
+                lock_guard<mutex> guard(lock);
+                return records;
+            }
+
+            bool write(const string& path){
+                FILE* file = fopen(path.c_str(), "w");
+                if(file == nullptr) return false;
+                fprintf(file, "{\"traceEvents\":[");
+                const auto regions = snapshot();
+                for(size_t i = 0; i < regions.size(); ++i){
+                    const RegionRecord& region = regions[i];
+                    fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f,\"args\":{"
+                            "\"allocations\":%llu,\"deallocations\":%llu,\"bytesAllocated\":%llu,\"bytesFreed\":%llu,\"liveBytesStart\":%llu,\"peakLiveBytes\":%llu,"
+                            "\"residentStartKB\":%llu,\"residentEndKB\":%llu,\"peakResidentKB\":%llu,"
+                            "\"threadsStart\":%llu,\"threadsEnd\":%llu,\"peakThreads\":%llu,\"samples\":%zu}}",
+                            (i == 0) ? "" : ",", escapeJson(region.name).c_str(), getpid(), region.depth,
+                            region.start.count() / 1e3, region.duration.count() / 1e3,
+                            (unsigned long long)region.allocations, (unsigned long long)region.deallocations,
+                            (unsigned long long)region.bytesAllocated, (unsigned long long)region.bytesFreed,
+                            (unsigned long long)region.liveBytesStart, (unsigned long long)region.peakLiveBytes, (unsigned long long)region.residentStartKB,
+                            (unsigned long long)region.residentEndKB, (unsigned long long)region.peakResidentKB,
+                            (unsigned long long)region.threadsStart, (unsigned long long)region.threadsEnd,
+                            (unsigned long long)region.peakThreads, region.samples);
+                }
+                fprintf(file, "\n]}\n");
+                return fclose(file) == 0;
+            }
+    };
+
+    inline Trace trace;
+    inline atomic<uint64_t> activeSamplers{0};
+
+    // Thread counts leave out the samplers of all open regions.
+    inline uint64_t applicationThreads(const ProcessStatus& status){
+        const uint64_t samplers = activeSamplers.load();
+        return (status.threads > samplers) ? status.threads - samplers : 0;
+    }
+
+    // Scoped measurement of a phase of the program. A sampler thread polls RSS and
+    // the thread count while the region is open, so short peaks that a 100 ms
+    // `watch` misses still show up; the allocation figures are exact. Regions may
+    // be open on several threads at once, each with its own peak of live bytes;
+    // live bytes are counted process wide, so a region also sees what other
+    // threads allocate meanwhile.
+    class Region{
+        private:
+            inline static thread_local Region* current = nullptr;
+            Region* const parent = current;
+            RegionRecord record;
+            size_t peakSlot;
+            uint64_t allocationsAtStart;
+            uint64_t deallocationsAtStart;
+            uint64_t bytesAllocatedAtStart;
+            uint64_t bytesFreedAtStart;
+            bool peakWasReset;
+            mutex samplerLock;
+            condition_variable samplerWakeUp;
+            bool stopping = false;
+            thread sampler;
+
+            void sample(){
+                const ProcessStatus status = readProcessStatus();
+                record.peakResidentKB = max(record.peakResidentKB, status.residentKB);
+                record.peakThreads = max(record.peakThreads, applicationThreads(status));
+                ++record.samples;
+            }
+
+        public:
+            explicit Region(string name, const microseconds samplingInterval = microseconds(1000)){
+                peakSlot = openPeakSlot();
+                current = this;
+                record = RegionRecord{move(name), (parent == nullptr) ? 0 : parent->record.depth + 1, trace.sinceStart(), nanoseconds(0), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+                const ProcessStatus status = readProcessStatus();
+                peakWasReset = resetPeakResident();
+                record.residentStartKB = status.residentKB;
+                record.peakResidentKB = status.residentKB;
+                record.threadsStart = applicationThreads(status);
+                record.peakThreads = record.threadsStart;
+                activeSamplers.fetch_add(1);
+
+                sampler = thread([this, samplingInterval](){
+                    unique_lock<mutex> guard(samplerLock);
+                    while(!samplerWakeUp.wait_for(guard, samplingInterval, [this](){ return stopping; })) sample();
+                });
+
+                // Counters are read after the sampler starts and before it stops, so
+                // its own thread state is not charged to the region.
+                allocationsAtStart = allocationCounters.allocations.load();
+                deallocationsAtStart = allocationCounters.deallocations.load();
+                bytesAllocatedAtStart = allocationCounters.bytesAllocated.load();
+                bytesFreedAtStart = allocationCounters.bytesFreed.load();
+                record.liveBytesStart = allocationCounters.liveBytes.load();
+            }
+
+            Region(const Region&) = delete;
+            Region& operator=(const Region&) = delete;
+
+            ~Region(){
+                record.allocations = allocationCounters.allocations.load() - allocationsAtStart;
+                record.deallocations = allocationCounters.deallocations.load() - deallocationsAtStart;
+                record.bytesAllocated = allocationCounters.bytesAllocated.load() - bytesAllocatedAtStart;
+                record.bytesFreed = allocationCounters.bytesFreed.load() - bytesFreedAtStart;
+                record.peakLiveBytes = max(record.liveBytesStart, closePeakSlot(peakSlot));
+
+                {
+                    lock_guard<mutex> guard(samplerLock);
+                    stopping = true;
+                }
+                samplerWakeUp.notify_one();
+                sampler.join();
+                activeSamplers.fetch_sub(1);
+
+                const ProcessStatus status = readProcessStatus();
+                record.residentEndKB = status.residentKB;
+                record.threadsEnd = applicationThreads(status);
+                record.peakThreads = max(record.peakThreads, record.threadsEnd);
+                if(peakWasReset) record.peakResidentKB = max(record.peakResidentKB, status.peakResidentKB);
+                record.peakResidentKB = max(record.peakResidentKB, status.residentKB);
+                record.duration = trace.sinceStart() - record.start;
+                // Nested regions reset VmHWM, so the enclosing region takes over their peak.
+                if(parent != nullptr){
+                    lock_guard<mutex> guard(parent->samplerLock);
+                    parent->record.peakResidentKB = max(parent->record.peakResidentKB, record.peakResidentKB);
+                }
+                current = parent;
+                trace.add(move(record));
+            }
+    };
+}
+
+// Replaceable allocation functions may not be inline, hence the single
+// translation unit requirement above.
+void* operator new(size_t size){ return telemetry::allocateOrThrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new[](size_t size){ return telemetry::allocateOrThrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new(size_t size, align_val_t alignment){ return telemetry::allocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, align_val_t alignment){ return telemetry::allocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, const nothrow_t&) noexcept{ return telemetry::allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new[](size_t size, const nothrow_t&) noexcept{ return telemetry::allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept{ return telemetry::allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept{ return telemetry::allocate(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void* pointer) noexcept{ telemetry::deallocate(pointer, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete[](void* pointer) noexcept{ telemetry::deallocate(pointer, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete(void* pointer, size_t) noexcept{ telemetry::deallocate(pointer, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete[](void* pointer, size_t) noexcept{ telemetry::deallocate(pointer, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete(void* pointer, align_val_t alignment) noexcept{ telemetry::deallocate(pointer, static_cast<size_t>(alignment)); }
+void operator delete[](void* pointer, align_val_t alignment) noexcept{ telemetry::deallocate(pointer, static_cast<size_t>(alignment)); }
+void operator delete(void* pointer, size_t, align_val_t alignment) noexcept{ telemetry::deallocate(pointer, static_cast<size_t>(alignment)); }
+void operator delete[](void* pointer, size_t, align_val_t alignment) noexcept{ telemetry::deallocate(pointer, static_cast<size_t>(alignment)); }
+void operator delete(void* pointer, const nothrow_t&) noexcept{ telemetry::deallocate(pointer, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete[](void* pointer, const nothrow_t&) noexcept{ telemetry::deallocate(pointer, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete(void* pointer, align_val_t alignment, const nothrow_t&) noexcept{ telemetry::deallocate(pointer, static_cast<size_t>(alignment)); }
+void operator delete[](void* pointer, align_val_t alignment, const nothrow_t&) noexcept{ telemetry::deallocate(pointer, static_cast<size_t>(alignment)); }
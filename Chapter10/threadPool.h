@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+template<typename T>
+struct PoolTaskState{
+    atomic<bool> ready{false};
+    optional<T> value;
+    exception_ptr error;
+};
+
+template<>
+struct PoolTaskState<void>{
+    atomic<bool> ready{false};
+    exception_ptr error;
+};
+
+class ThreadPool;
+
+// Result of ThreadPool::submit. There is no mutex or condition variable in the
+// shared state: a thread calling get() runs other pending pool tasks while it
+// waits, so waiting from inside a pool task cannot deadlock the pool.
+template<typename T>
+class PoolFuture{
+    private:
+        shared_ptr<PoolTaskState<T>> state;
+        ThreadPool* pool;
+
+    public:
+        PoolFuture(shared_ptr<PoolTaskState<T>> state, ThreadPool* pool) : state(state), pool(pool){};
+
+        bool ready() const{
+            return state->ready.load(memory_order_acquire);
+        }
+
+        void wait() const;
+
+        T get(){
+            wait();
+            if(state->error) rethrow_exception(state->error);
+            if constexpr(!is_void<T>::value) return move(*state->value);
+        }
+};
+
+// Fixed size work stealing pool. Every worker owns a deque: it pushes and pops
+// its own tasks at the back and steals from the front of the other deques when
+// its own runs dry. Tasks submitted from outside the pool are spread round robin.
+class ThreadPool{
+    private:
+        struct alignas(64) WorkerQueue{
+            mutex lock;
+            deque<function<void()>> tasks;
+        };
+
+        vector<unique_ptr<WorkerQueue>> queues;
+        vector<thread> workers;
+        atomic<bool> stopping;
+        atomic<size_t> pending;
+        atomic<size_t> nextQueue;
+        mutex sleepLock;
+        condition_variable wakeUp;
+
+        inline static thread_local ThreadPool* currentPool = nullptr;
+        inline static thread_local size_t currentWorker = 0;
+
+        bool popOwn(const size_t index, function<void()>& task){
+            WorkerQueue& queue = *queues[index];
+            lock_guard<mutex> guard(queue.lock);
+            if(queue.tasks.empty()) return false;
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+
+        bool steal(const size_t thief, function<void()>& task){
+            for(size_t offset = 1; offset <= queues.size(); ++offset){
+                WorkerQueue& queue = *queues[(thief + offset) % queues.size()];
+                unique_lock<mutex> guard(queue.lock, try_to_lock);
+                if(!guard.owns_lock() || queue.tasks.empty()) continue;
+                task = move(queue.tasks.front());
+                queue.tasks.pop_front();
+                return true;
+            }
+            return false;
+        }
+
+        bool runOne(const size_t index, const bool isWorker){
+            function<void()> task;
+            if(!(isWorker && popOwn(index, task)) && !steal(index, task)) return false;
+            pending.fetch_sub(1, memory_order_relaxed);
+            task();
+            return true;
+        }
+
+        void workerLoop(const size_t index){
+            currentPool = this;
+            currentWorker = index;
+            while(true){
+                if(runOne(index, true)) continue;
+                unique_lock<mutex> guard(sleepLock);
+                wakeUp.wait(guard, [this](){ return stopping.load() || pending.load() > 0; });
+                if(stopping.load() && pending.load() == 0) return;
+            }
+        }
+
+        void push(function<void()> task){
+            const bool fromWorker = (currentPool == this);
+            const size_t index = fromWorker ? currentWorker : nextQueue.fetch_add(1, memory_order_relaxed) % queues.size();
+            {
+                lock_guard<mutex> guard(queues[index]->lock);
+                queues[index]->tasks.push_back(move(task));
+            }
+            pending.fetch_add(1, memory_order_release);
+            // Taking the sleep lock orders this wake up after a worker's check of `pending`.
+            { lock_guard<mutex> guard(sleepLock); }
+            wakeUp.notify_one();
+        }
+
+    public:
+        explicit ThreadPool(size_t threadCount = thread::hardware_concurrency()) : stopping(false), pending(0), nextQueue(0){
+            threadCount = max<size_t>(threadCount, 1);
+            for(size_t i = 0; i < threadCount; ++i) queues.push_back(make_unique<WorkerQueue>());
+            for(size_t i = 0; i < threadCount; ++i) workers.emplace_back([this, i](){ workerLoop(i); });
+        };
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool(){
+            {
+                lock_guard<mutex> guard(sleepLock);
+                stopping.store(true);
+            }
+            wakeUp.notify_all();
+            for(auto& worker : workers) worker.join();
+        }
+
+        size_t size() const{
+            return workers.size();
+        }
+
+        template<typename F>
+        auto submit(F f) -> PoolFuture<invoke_result_t<F&>>{
+            typedef invoke_result_t<F&> ResultType;
+            auto state = make_shared<PoolTaskState<ResultType>>();
+            push([state, f]() mutable{
+                try{
+                    if constexpr(is_void<ResultType>::value) f();
+                    else state->value.emplace(f());
+                } catch(...){
+                    state->error = current_exception();
+                }
+                state->ready.store(true, memory_order_release);
+            });
+            return PoolFuture<ResultType>(state, this);
+        }
+
+        // Runs one pending task on the calling thread, if there is any.
+        bool helpWhileWaiting(){
+            const bool isWorker = (currentPool == this);
+            return runOne(isWorker ? currentWorker : 0, isWorker);
+        }
+};
+
+template<typename T>
+void PoolFuture<T>::wait() const{
+    while(!ready()){
+        if(!pool->helpWhileWaiting()) this_thread::yield();
+    }
+}
+
+// Chunk length for splitting `size` elements over the pool: about four chunks
+// per worker, so stealing can even out uneven chunks, never below `minimumGrain`.
+// Chunks are whole multiples of 64 elements, which keeps every chunk of a
+// vector<bool> on its own words so chunks can be written concurrently.
+inline size_t grainSizeFor(const size_t size, const size_t workerCount, const size_t minimumGrain = 1024){
+    const size_t grain = max(minimumGrain, size / max<size_t>(workerCount * 4, 1));
+    return (grain + 63) / 64 * 64;
+}
+
+template<typename DestinationType>
+auto parallelTransformAll = [](ThreadPool& pool, const auto& source, auto lambda, size_t grain = 0){
+    const size_t size = source.size();
+    DestinationType result(size);
+    if(grain == 0) grain = grainSizeFor(size, pool.size());
+    // Chunks of a vector<bool> must not share a word, whatever grain was asked for.
+    if constexpr(is_same<DestinationType, vector<bool>>::value) grain = (grain + 63) / 64 * 64;
+
+    vector<PoolFuture<void>> chunks;
+    for(size_t begin = 0; begin < size; begin += grain){
+        const size_t end = min(size, begin + grain);
+        chunks.push_back(pool.submit([&source, &result, &lambda, begin, end](){
+            transform(source.begin() + begin, source.begin() + end, result.begin() + begin, lambda);
+        }));
+    }
+    // Every chunk refers to `source` and `result`, so all of them must be done
+    // before the first failure is rethrown and those go out of scope.
+    for(auto& chunk : chunks) chunk.wait();
+    for(auto& chunk : chunks) chunk.get();
+    return result;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+using namespace std;
+
+// Runs tail recursive functions in constant stack space. Instead of calling
+// itself, a step function returns what to do next: either done(result) or
+// call(arguments...) for another round. The loop in run() makes that call, so
+// the stack never grows, whatever the compiler does with sibling calls.
+// Mutually recursive functions share one signature and name each other by
+// their position: callFunction(index, arguments...). A Step is a plain
+// variant, so there is no allocation per step.
+template<typename R, typename... Args>
+class Trampoline{
+    public:
+        struct Call{
+            size_t function;
+            bool sameFunction;
+            tuple<Args...> arguments;
+        };
+
+        typedef variant<R, Call> Step;
+
+        static Step done(R result){
+            return Step(in_place_index<0>, move(result));
+        }
+
+        static Step call(Args... arguments){
+            return Step(in_place_index<1>, Call{0, true, tuple<Args...>(move(arguments)...)});
+        }
+
+        static Step callFunction(const size_t function, Args... arguments){
+            return Step(in_place_index<1>, Call{function, false, tuple<Args...>(move(arguments)...)});
+        }
+
+        template<typename... Functions>
+        static R run(const tuple<Functions...>& functions, const size_t first, Args... arguments){
+            return runFrom(functions, index_sequence_for<Functions...>(), first, tuple<Args...>(move(arguments)...));
+        }
+
+        template<typename Function>
+        static R run(const Function& function, Args... arguments){
+            return run(tuple<const Function&>(function), 0, move(arguments)...);
+        }
+
+    private:
+        // One function pointer per element of the tuple, so dispatching a call
+        // is an indexed jump instead of a chain of comparisons.
+        template<typename Functions, size_t... Index>
+        static R runFrom(const Functions& functions, index_sequence<Index...>, size_t current, tuple<Args...> arguments){
+            typedef Step (*Invoker)(const Functions&, tuple<Args...>&);
+            static constexpr Invoker invokers[] = {
+                [](const Functions& functions, tuple<Args...>& arguments) -> Step{
+                    return apply(get<Index>(functions), move(arguments));
+                }...
+            };
+
+            Step step = invokers[current](functions, arguments);
+            while(step.index() == 1){
+                Call& next = get<1>(step);
+                if(!next.sameFunction) current = next.function;
+                arguments = move(next.arguments);
+                step = invokers[current](functions, arguments);
+            }
+            return move(get<0>(step));
+        }
+};
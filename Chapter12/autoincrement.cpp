@@ -1,11 +1,16 @@
+#include <algorithm>
 #include <iostream>
 #include <list>
 #include <map>
 #include <string>
 #include <functional>
 #include <numeric>
+#include <thread>
+#include <vector>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "idGenerator.h"
+#include "timing.h"
 
 using namespace std;
 using namespace std::placeholders;
@@ -48,3 +53,87 @@ TEST_CASE("Compute next auto increment index"){
     const auto newAutoIncrementIndex = computeNextAutoIncrement(nextAutoIncrementIndex);
     CHECK_EQ(3, value(newAutoIncrementIndex));
 }
+
+TEST_CASE("Ids from a block of the shared source"){
+    IdSource source(1, 3);
+    const auto first = initIds(source);
+    CHECK_EQ(1, first.id);
+
+    const auto second = nextId(first);
+    CHECK_EQ(2, second.id);
+    CHECK_EQ(1, first.id);
+    CHECK_EQ(3, nextId(second).id);
+
+    const auto otherHolder = initIds(source);
+    CHECK_EQ(4, otherHolder.id);
+    CHECK_EQ(7, nextId(nextId(second)).id);
+}
+
+TEST_CASE("Reserve a batch of ids"){
+    IdSource source(1, 10);
+    const auto state = initIds(source);
+
+    SUBCASE("from the rest of the block"){
+        const auto batch = takeIds(state, 4);
+        CHECK_EQ(2, batch.ids.first);
+        CHECK_EQ(4, batch.ids.size());
+        CHECK_EQ(6, nextId(batch.next).id);
+    }
+
+    SUBCASE("larger than the rest of the block"){
+        const auto batch = takeIds(state, 100);
+        CHECK_EQ(11, batch.ids.first);
+        CHECK_EQ(111, batch.ids.end);
+        CHECK_EQ(2, nextId(batch.next).id);
+        CHECK_EQ(111, source.peek());
+    }
+}
+
+TEST_CASE("Ids are unique and dense across threads"){
+    const size_t threads = 4;
+    const size_t idsPerThread = 100000;
+    IdSource source(1, 1000);
+    vector<vector<uint64_t>> issued(threads);
+
+    vector<thread> workers;
+    for(size_t worker = 0; worker < threads; ++worker){
+        workers.emplace_back([&, worker](){
+            auto state = initIds(source);
+            issued[worker].push_back(state.id);
+            for(size_t i = 1; i < idsPerThread; ++i){
+                state = nextId(state);
+                issued[worker].push_back(state.id);
+            }
+        });
+    }
+    for(auto& worker : workers) worker.join();
+
+    vector<uint64_t> all;
+    for(const auto& ids : issued) all.insert(all.end(), ids.begin(), ids.end());
+    sort(all.begin(), all.end());
+    CHECK(adjacent_find(all.begin(), all.end()) == all.end());
+    CHECK_EQ(1, all.front());
+    CHECK_EQ(threads * idsPerThread, all.back());
+}
+
+TEST_CASE("Id generation cost" * doctest::skip()){
+    const size_t ids = 20000000;
+    // Every run starts from a new source, so every run hands out the same ids.
+    const uint64_t expected = timePerUnit("pair with std::function: ", ids, "id", [ids](){
+        auto current = initAutoIncrement(1);
+        for(size_t i = 1; i < ids; ++i) current = computeNextAutoIncrement(current);
+        return static_cast<uint64_t>(value(current));
+    });
+    CHECK_EQ(expected, timePerUnit("atomic add per id: ", ids, "id", [ids](){
+        IdSource shared;
+        uint64_t last = 0;
+        for(size_t i = 0; i < ids; ++i) last = shared.reserve(1).first;
+        return last;
+    }));
+    CHECK_EQ(expected, timePerUnit("IdState over blocks: ", ids, "id", [ids](){
+        IdSource source;
+        auto state = initIds(source);
+        for(size_t i = 1; i < ids; ++i) state = nextId(state);
+        return state.id;
+    }));
+}
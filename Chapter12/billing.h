@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+typedef uint32_t DrinkId;
+
+// Drink names turned into dense ids once, when an order is taken, so billing
+// only indexes a vector of prices. Unlike map::operator[], asking for a drink
+// that is not on the menu is an error instead of a new drink priced 0.
+class DrinkMenu{
+    private:
+        unordered_map<string, DrinkId> ids;
+        vector<string> names;
+        vector<double> prices;
+
+    public:
+        DrinkMenu() = default;
+
+        DrinkMenu(const initializer_list<pair<string, double>> drinks){
+            for(const auto& [name, price] : drinks) add(name, price);
+        }
+
+        DrinkId add(const string& name, const double price){
+            const auto [found, inserted] = ids.emplace(name, static_cast<DrinkId>(prices.size()));
+            if(!inserted) throw invalid_argument(name + " is already on the menu");
+            names.push_back(name);
+            prices.push_back(price);
+            return found->second;
+        }
+
+        DrinkId idOf(const string& name) const{
+            const auto found = ids.find(name);
+            if(found == ids.end()) throw out_of_range(name + " is not on the menu");
+            return found->second;
+        }
+
+        vector<DrinkId> resolve(const vector<string>& drinks) const{
+            vector<DrinkId> resolved;
+            resolved.reserve(drinks.size());
+            for(const string& drink : drinks) resolved.push_back(idOf(drink));
+            return resolved;
+        }
+
+        const string& nameOf(const DrinkId id) const{
+            return names[id];
+        }
+
+        const double* priceTable() const{
+            return prices.data();
+        }
+
+        size_t size() const{
+            return prices.size();
+        }
+};
+
+// Billing strategies as plain types, for the variant based dispatch.
+struct NormalBilling{
+    double operator()(const double price) const{ return price; }
+};
+
+struct HappyHourBilling{
+    double operator()(const double price) const{ return price / 2; }
+};
+
+struct DiscountBilling{
+    double percentage;
+    double operator()(const double price) const{ return price * (100 - percentage) / 100; }
+};
+
+typedef variant<NormalBilling, HappyHourBilling, DiscountBilling> BillingStrategy;
+
+// Many orders in three flat vectors: the drinks of order i are
+// drinks[orderEnds[i - 1] .. orderEnds[i]), billed with strategies[i], an index
+// into the strategy table given to billBatch.
+struct OrderBatch{
+    vector<DrinkId> drinks;
+    vector<uint32_t> orderEnds;
+    vector<uint8_t> strategies;
+
+    void add(const vector<DrinkId>& order, const uint8_t strategy = 0){
+        drinks.insert(drinks.end(), order.begin(), order.end());
+        orderEnds.push_back(static_cast<uint32_t>(drinks.size()));
+        strategies.push_back(strategy);
+    }
+
+    size_t size() const{
+        return orderEnds.size();
+    }
+
+    void clear(){
+        drinks.clear();
+        orderEnds.clear();
+        strategies.clear();
+    }
+};
+
+// One pass over the batch: every order is summed straight from the price table
+// and its strategy applied to the sum, the same arithmetic as computeBill
+// without the vector of prices in between. Writes one bill per order. Any menu
+// with a priceTable() indexed by the drink ids of the batch will do.
+template<typename Menu, typename Strategy>
+void billBatch(const Menu& menu, const OrderBatch& batch, Strategy strategy, vector<double>& bills){
+    const double* prices = menu.priceTable();
+    const DrinkId* drinks = batch.drinks.data();
+    bills.resize(batch.size());
+    uint32_t begin = 0;
+    for(size_t order = 0; order < batch.size(); ++order){
+        const uint32_t end = batch.orderEnds[order];
+        double sum = 0.0;
+        for(uint32_t drink = begin; drink < end; ++drink) sum += prices[drinks[drink]];
+        bills[order] = strategy(sum);
+        begin = end;
+    }
+}
+
+// Each order picks its strategy from `strategies` by index; the variant is
+// visited once per order, not once per drink.
+template<typename Menu>
+void billBatch(const Menu& menu, const OrderBatch& batch, const vector<BillingStrategy>& strategies, vector<double>& bills){
+    size_t order = 0;
+    billBatch(menu, batch, [&](const double sum){
+        const BillingStrategy& strategy = strategies.at(batch.strategies[order++]);
+        return visit([sum](const auto& billing){ return billing(sum); }, strategy);
+    }, bills);
+}
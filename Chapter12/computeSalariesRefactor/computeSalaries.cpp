@@ -1,43 +1,116 @@
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <cmath>
 #include <functional>
+#include <thread>
 #include "computeSalaries.h"
+#include "csvReader.h"
+#include "incrementalSalaries.h"
+#include "salaryOutput.h"
 
 using namespace std;
 
-int main(){
-    string id;
-    string employee_id;
-    string first_name;
-    string last_name;
-    string seniority_level;
-    string position;
-    string years_worked_continuously;
-    string special_bonus_level;
-
-    ifstream employeesFile("./Employees.csv");
-    while (getline(employeesFile, id, ',')) {
-        getline(employeesFile, employee_id, ',') ;
-        getline(employeesFile, first_name, ',') ;
-        getline(employeesFile, last_name, ',') ;
-        getline(employeesFile, seniority_level, ',') ;
-        getline(employeesFile, position, ',') ;
-        getline(employeesFile, years_worked_continuously, ',') ;
-        getline(employeesFile, special_bonus_level);
-        if(id == "id") continue;
-
-        BaseSalaryForPosition theBaseSalaryForPosition(position);
-
-        auto bonusFactor = bind(specialBonusFactor, [&](){ return bonusLevel(special_bonus_level); } );
-        auto roundedSalary = computeSalary(
-                theBaseSalaryForPosition,
-                bind(factorForSeniority, seniority_level),
-                bind(factorForContinuity, years_worked_continuously),
-                bonusFactor
-            );
-
-        cout  << seniority_level << position << " " << first_name << " " << last_name << " (" << years_worked_continuously << "yrs)" <<  ", " << employee_id << ", has salary (bonus level  " << special_bonus_level << ") " << roundedSalary << endl;
+// Rows are read and formatted in chunks of about this many bytes, one chunk per
+// worker at a time, so memory use does not grow with the input file.
+const size_t chunkBytes = 16 << 20;
+
+// Hands a TextWriter on stdout to `write` and flushes what is left in it. Lost
+// output must not pass for a finished run, so a failed write is reported and
+// the exit status is 1.
+template<typename F>
+int writeToStdout(F write){
+    TextWriter output;
+    try{
+        write(output);
+        output.flush();
+    } catch(const runtime_error& error){
+        cerr << error.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// computeSalaries --incremental index.bin [Employees.csv]: prints the delta
+// against the last run to stderr and every employee_id,salary to stdout.
+int incrementalMain(const string& indexPath, const string& employeesPath){
+    MappedFile employeesFile(employeesPath);
+    SalaryIndex index = SalaryIndex::load(indexPath);
+    const IncrementalSalaries result = recomputeSalaries(employeesFile.contents(), index);
+    index.save(indexPath);
+
+    for(const SalaryChange& change : result.changes){
+        cerr << nameOf(change.kind) << " " << change.employeeId << " " << change.oldSalary << " -> " << change.newSalary << "\n";
+    }
+    cerr << result.recomputed << " recomputed, " << result.reused << " reused" << endl;
+    return writeToStdout([&](TextWriter& output){
+        for(const EmployeeSalary& employee : result.salaries) output << employee.employeeId << ',' << employee.salary << '\n';
+    });
+}
+
+// computeSalaries --columns salaries.bin [Employees.csv]: writes employee ids and
+// salaries in the mappable format of salaryOutput.h instead of text.
+int columnsMain(const string& columnsPath, const string& employeesPath){
+    MappedFile employeesFile(employeesPath);
+    const size_t workers = max(1u, thread::hardware_concurrency());
+
+    SalaryColumnsFileWriter file(columnsPath);
+    parallelMapRowChunksInWaves<SalaryColumnsWriter>(employeesFile.contents(), workers, chunkBytes, [](string_view rows){
+        SalaryColumnsWriter columns;
+        vector<string_view> fields;
+        forEachRow(rows, fields, [&](const vector<string_view>& row){
+            if(row.size() < 8 || row[0] == "id") return;
+            columns.add(row[1], salaryFor(row[5], row[4], row[6], row[7]));
+        });
+        return columns;
+    }, [&](const SalaryColumnsWriter& chunk){ file.append(chunk); });
+    file.finish();
+    cerr << file.size() << " salaries written to " << columnsPath << endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    if(argc > 1 && string(argv[1]) == "--incremental"){
+        if(argc < 3){
+            cerr << "usage: " << argv[0] << " --incremental index.bin [Employees.csv]" << endl;
+            return 2;
+        }
+        return incrementalMain(argv[2], (argc > 3) ? argv[3] : "./Employees.csv");
+    }
+    if(argc > 1 && string(argv[1]) == "--columns"){
+        if(argc < 3){
+            cerr << "usage: " << argv[0] << " --columns salaries.bin [Employees.csv]" << endl;
+            return 2;
+        }
+        return columnsMain(argv[2], (argc > 3) ? argv[3] : "./Employees.csv");
     }
+    MappedFile employeesFile((argc > 1) ? argv[1] : "./Employees.csv");
+    const size_t workers = max(1u, thread::hardware_concurrency());
+
+    auto formatRows = [](string_view rows){
+        string output;
+        vector<string_view> fields;
+        forEachRow(rows, fields, [&](const vector<string_view>& row){
+            if(row.size() < 8 || row[0] == "id") return;
+            const string_view employee_id = row[1];
+            const string_view first_name = row[2];
+            const string_view last_name = row[3];
+            const string_view seniority_level = row[4];
+            const string_view position = row[5];
+            const string_view years_worked_continuously = row[6];
+            const string_view special_bonus_level = row[7];
+
+            auto roundedSalary = salaryFor(position, seniority_level, years_worked_continuously, special_bonus_level);
+
+            output.append(seniority_level).append(position).append(" ").append(first_name).append(" ").append(last_name)
+                .append(" (").append(years_worked_continuously).append("yrs), ").append(employee_id)
+                .append(", has salary (bonus level  ").append(special_bonus_level).append(") ");
+            appendSalary(output, roundedSalary);
+            output.push_back('\n');
+        });
+        return output;
+    };
+
+    return writeToStdout([&](TextWriter& output){
+        parallelMapRowChunksInWaves<string>(employeesFile.contents(), workers, chunkBytes, formatRows, [&](const string& chunk){ output << chunk; });
+    });
 }
@@ -1,7 +1,26 @@
+#ifndef COMPUTE_SALARIES_H
+#define COMPUTE_SALARIES_H
+
 #include <string>
+#include <string_view>
 #include <cmath>
+#include <cctype>
+#include <charconv>
+#include <functional>
+#include <stdexcept>
+#include "ruleTables.h"
 using namespace std;
 
+// stoi for string_view: skips leading whitespace and throws invalid_argument
+// when there is no number.
+auto toInt = [](string_view text){
+    while(!text.empty() && isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if(error != errc()) throw invalid_argument("not a number: " + string(text));
+    return value;
+};
+
 template<typename F, typename G>
 auto compose(F f, G g){
     return [f, g](auto x){
@@ -9,63 +28,83 @@ auto compose(F f, G g){
     };
 };
 
-auto baseSalaryForPosition = [](const string& position){
-    int baseSalary;
-    if(position == "Tester") baseSalary = 1500;
-    if(position == "Analyst") baseSalary = 1600;
-    if(position == "Developer") baseSalary = 2000;
-    if(position == "Team Leader") baseSalary = 3000;
-    if(position == "Manager") baseSalary = 4000;
-    return baseSalary;
+// The salary rules. An unknown position or seniority level is worth nothing;
+// years worked that are not a number are an error, thrown by toInt.
+constexpr auto baseSalaries = makePerfectHashTable<int>({
+        {"Tester", 1500},
+        {"Analyst", 1600},
+        {"Developer", 2000},
+        {"Team Leader", 3000},
+        {"Manager", 4000}
+    });
+
+constexpr auto seniorityFactors = makePerfectHashTable<double>({
+        {"Entry", 1},
+        {"Junior", 1.2},
+        {"Senior", 1.5}
+    });
+
+constexpr auto continuityFactors = makeIntervalTable<double>({
+        {fromLowest, 1},
+        {3, 1.2},
+        {5, 1.5},
+        {10, 1.7},
+        {21, 2}
+    });
+
+constexpr double bonusFactorPerLevel = 0.03;
+
+auto baseSalaryForPosition = [](string_view position){
+    return baseSalaries.valueOr(position, 0);
 };
 
 class BaseSalaryForPosition{
     private:
-        const string& position;
+        string_view position;
 
     public:
-        BaseSalaryForPosition(const string& position) : position(position){};
+        BaseSalaryForPosition(string_view position) : position(position){};
 
         int baseSalaryForPosition() const{
-            int baseSalary;
-            if(position == "Tester") baseSalary = 1500;
-            if(position == "Analyst") baseSalary = 1600;
-            if(position == "Developer") baseSalary = 2000;
-            if(position == "Team Leader") baseSalary = 3000;
-            if(position == "Manager") baseSalary = 4000;
-            return baseSalary;
+            return baseSalaries.valueOr(position, 0);
         }
 };
 
-auto factorForSeniority = [](const string& seniority_level){
-    double factor;
-    if(seniority_level == "Entry") factor = 1;
-    if(seniority_level == "Junior") factor = 1.2;
-    if(seniority_level == "Senior") factor = 1.5;
-    return factor;
+auto factorForSeniority = [](string_view seniority_level){
+    return seniorityFactors.valueOr(seniority_level, 0);
 };
 
-auto factorForContinuity = [](const string& years_worked_continuously){
-    double continuityFactor;
-    int continuity = stoi(years_worked_continuously);
-    if(continuity < 3) continuityFactor = 1;
-    if(continuity >= 3 && continuity < 5) continuityFactor = 1.2;
-    if(continuity >= 5 && continuity < 10) continuityFactor = 1.5;
-    if(continuity >=10 && continuity <= 20) continuityFactor = 1.7;
-    if(continuity > 20) continuityFactor = 2;
-    return continuityFactor;
+auto factorForContinuity = [](string_view years_worked_continuously){
+    return continuityFactors.at(toInt(years_worked_continuously));
 };
 
-auto bonusLevel = [](const string& special_bonus_level){
-    return stoi(special_bonus_level);
+auto bonusLevel = [](string_view special_bonus_level){
+    return toInt(special_bonus_level);
 };
 
 auto specialBonusFactor = [] (auto bonusLevel) {
-    return bonusLevel() * 0.03;
+    return bonusLevel() * bonusFactorPerLevel;
+};
+
+// The salary formula on already computed factors, shared with the columnar path.
+inline double salaryFromFactors(const double bonusFactor, const double baseSalary, const double seniorityFactor, const double continuityFactor){
+    return ceil((1 + bonusFactor) * baseSalary * seniorityFactor * continuityFactor);
+}
+
+auto computeSalary = [](const auto& baseSalaryForPosition, auto factorForSeniority, auto factorForContinuity, auto bonusFactor){
+    return salaryFromFactors(bonusFactor(), baseSalaryForPosition.baseSalaryForPosition(), factorForSeniority(), factorForContinuity());
 };
 
-auto computeSalary = [](const BaseSalaryForPosition& baseSalaryForPosition, auto factorForSeniority, auto factorForContinuity, auto bonusFactor){
-    return ceil (
-            (1 + bonusFactor()) * baseSalaryForPosition.baseSalaryForPosition() * factorForSeniority() * factorForContinuity()
-            );
+auto salaryFor = [](string_view position, string_view seniority_level, string_view years_worked_continuously, string_view special_bonus_level){
+    BaseSalaryForPosition theBaseSalaryForPosition(position);
+
+    auto bonusFactor = bind(specialBonusFactor, [&](){ return bonusLevel(special_bonus_level); } );
+    return computeSalary(
+            theBaseSalaryForPosition,
+            bind(factorForSeniority, seniority_level),
+            bind(factorForContinuity, years_worked_continuously),
+            bonusFactor
+        );
 };
+
+#endif
@@ -1,6 +1,16 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <thread>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 #include "computeSalaries.h"
+#include "csvReader.h"
+#include "employeeTable.h"
+#include "incrementalSalaries.h"
+#include "salaryOutput.h"
+#include "../timing.h"
 
 using namespace std;
 
@@ -13,4 +23,461 @@ TEST_CASE("Base salary"){
     CHECK_EQ(0, baseSalaryForPosition("asdfasdfs"));
 }
 
+TEST_CASE("Rule tables"){
+    static_assert(baseSalaries.valueOr("Team Leader", 0) == 3000);
+    static_assert(!baseSalaries.contains("Team"));
+    static_assert(continuityFactors.valueOr(20, 0) == 1.7);
+    static_assert(!baseSalaries.hashesWholeKey());
 
+    SUBCASE("seniority"){
+        CHECK_EQ(1, factorForSeniority("Entry"));
+        CHECK_EQ(1.2, factorForSeniority("Junior"));
+        CHECK_EQ(1.5, factorForSeniority("Senior"));
+        CHECK_EQ(0, factorForSeniority("Medium"));
+        CHECK_EQ(0, factorForSeniority(""));
+    }
+
+    SUBCASE("continuity at the edges of every interval"){
+        CHECK_EQ(1, factorForContinuity("-1"));
+        CHECK_EQ(1, factorForContinuity("2"));
+        CHECK_EQ(1.2, factorForContinuity("3"));
+        CHECK_EQ(1.2, factorForContinuity("4"));
+        CHECK_EQ(1.5, factorForContinuity("5"));
+        CHECK_EQ(1.5, factorForContinuity("9"));
+        CHECK_EQ(1.7, factorForContinuity("10"));
+        CHECK_EQ(1.7, factorForContinuity("20"));
+        CHECK_EQ(2, factorForContinuity("21"));
+        CHECK_EQ(2, factorForContinuity("2147483647"));
+        CHECK_THROWS_AS(factorForContinuity("many"), invalid_argument);
+    }
+
+    SUBCASE("unknown keys and inputs"){
+        constexpr auto table = makePerfectHashTable<int>({{"a", 1}, {"b", 2}});
+        CHECK(table.find("c") == nullptr);
+        CHECK_EQ(-1, table.valueOr("c", -1));
+        CHECK_EQ(2, table.at("b"));
+        CHECK_THROWS_AS(table.at("c"), out_of_range);
+
+        constexpr auto sameShape = makePerfectHashTable<int>({{"abc", 1}, {"adc", 2}, {"", 3}});
+        static_assert(sameShape.hashesWholeKey());
+        CHECK_EQ(1, sameShape.at("abc"));
+        CHECK_EQ(2, sameShape.at("adc"));
+        CHECK_EQ(3, sameShape.at(""));
+        CHECK(sameShape.find("aec") == nullptr);
+
+        constexpr auto fromZero = makeIntervalTable<char>({{0, 'a'}, {10, 'b'}});
+        CHECK(fromZero.find(-1) == nullptr);
+        CHECK_EQ('a', fromZero.at(0));
+        CHECK_EQ('b', fromZero.at(10));
+        CHECK_THROWS_AS(fromZero.at(-1), out_of_range);
+    }
+}
+
+TEST_CASE("Rule table vs if chain lookup cost" * doctest::skip()){
+    auto ifChain = [](string_view position){
+        int baseSalary = 0;
+        if(position == "Tester") baseSalary = 1500;
+        if(position == "Analyst") baseSalary = 1600;
+        if(position == "Developer") baseSalary = 2000;
+        if(position == "Team Leader") baseSalary = 3000;
+        if(position == "Manager") baseSalary = 4000;
+        return baseSalary;
+    };
+    const vector<string> positions = {"Tester", "Analyst", "Developer", "Team Leader", "Manager", "Intern"};
+    const size_t lookups = 20000000;
+
+    auto sumOfLookups = [&](auto lookup){
+        long sum = 0;
+        for(size_t i = 0; i < lookups; ++i) sum += lookup(string_view(positions[i % positions.size()]));
+        return sum;
+    };
+
+    const long expected = timePerUnit("if chain: ", lookups, "lookup", [&](){ return sumOfLookups(ifChain); });
+    CHECK_EQ(expected, timePerUnit("perfect hash table: ", lookups, "lookup", [&](){ return sumOfLookups(baseSalaryForPosition); }));
+}
+
+TEST_CASE("CSV fields"){
+    vector<string_view> fields;
+
+    splitFields("1,abc,De Vuyst,Junior", fields);
+    CHECK_EQ(vector<string_view>{"1", "abc", "De Vuyst", "Junior"}, fields);
+
+    splitFields("a,,c,\r", fields);
+    CHECK_EQ(vector<string_view>{"a", "", "c", ""}, fields);
+
+    splitFields("\"Vuyst, De\",\"say \"\"hi\"\"\",\"\",x", fields);
+    CHECK_EQ(vector<string_view>{"Vuyst, De", "say \"\"hi\"\"", "", "x"}, fields);
+    CHECK_EQ("say \"hi\"", unescapeField(fields[1]));
+}
+
+TEST_CASE("CSV rows and row aligned chunks"){
+    string data = "id,name,note\n";
+    for(int row = 0; row < 500; ++row){
+        data += to_string(row) + ",\"Name, " + to_string(row) + "\",\"line one\nline \"\"two\"\"\"\r\n";
+        data += to_string(row) + ",plain,\n";
+    }
+
+    vector<string> sequential;
+    vector<string_view> fields;
+    CHECK_EQ(1001, forEachRow(data, fields, [&](const vector<string_view>& row){
+        REQUIRE_EQ(3, row.size());
+        sequential.push_back(string(row[0]) + "|" + string(row[1]) + "|" + string(row[2]));
+    }));
+    CHECK_EQ("7|Name, 7|line one\nline \"\"two\"\"", sequential[15]);
+
+    for(size_t chunkCount : {1, 2, 3, 7, 64, 5000}){
+        vector<string> chunked;
+        for(const string_view chunk : splitIntoRowChunks(data, chunkCount, 4)){
+            forEachRow(chunk, fields, [&](const vector<string_view>& row){
+                chunked.push_back(string(row[0]) + "|" + string(row[1]) + "|" + string(row[2]));
+            });
+        }
+        CHECK_EQ(sequential, chunked);
+    }
+}
+
+// The getline loop of computeSalaries.cpp before the CSV reader, returning the
+// sum of all salaries instead of printing them.
+auto sumOfSalariesWithGetline = [](const string& path){
+    string id, employee_id, first_name, last_name, seniority_level, position, years_worked_continuously, special_bonus_level;
+    ifstream employeesFile(path);
+    double sum = 0;
+    while (getline(employeesFile, id, ',')) {
+        getline(employeesFile, employee_id, ',') ;
+        getline(employeesFile, first_name, ',') ;
+        getline(employeesFile, last_name, ',') ;
+        getline(employeesFile, seniority_level, ',') ;
+        getline(employeesFile, position, ',') ;
+        getline(employeesFile, years_worked_continuously, ',') ;
+        getline(employeesFile, special_bonus_level);
+        if(id == "id") continue;
+        sum += salaryFor(position, seniority_level, years_worked_continuously, special_bonus_level);
+    }
+    return sum;
+};
+
+auto sumOfSalaries = [](string_view rows){
+    double sum = 0;
+    vector<string_view> fields;
+    forEachRow(rows, fields, [&](const vector<string_view>& row){
+        if(row.size() < 8 || row[0] == "id") return;
+        sum += salaryFor(row[5], row[4], row[6], row[7]);
+    });
+    return sum;
+};
+
+// Employees.csv rows with a seniority level the salary rules know about.
+auto writeEmployeesFile = [](const string& path, const size_t copies){
+    ifstream source("./Employees.csv");
+    string line;
+    vector<string> rows;
+    while(getline(source, line)){
+        if(line.find(",Medium,") == string::npos) rows.push_back(line);
+    }
+    ofstream destination(path);
+    destination << rows[0] << "\n";
+    for(size_t copy = 0; copy < copies; ++copy){
+        for(size_t row = 1; row < rows.size(); ++row) destination << rows[row] << "\n";
+    }
+    return copies * (rows.size() - 1);
+};
+
+TEST_CASE("Salaries from the CSV reader match the getline loop"){
+    const string path = (filesystem::temp_directory_path() / "employeesKnownSeniority.csv").string();
+    writeEmployeesFile(path, 3);
+
+    MappedFile employees(path);
+    const double expected = sumOfSalariesWithGetline(path);
+    CHECK_EQ(expected, sumOfSalaries(employees.contents()));
+    auto partialSums = parallelMapRowChunks<double>(employees.contents(), 4, sumOfSalaries);
+    CHECK_EQ(expected, accumulate(partialSums.begin(), partialSums.end(), 0.0));
+
+    SUBCASE("in waves of small chunks, consumed in file order"){
+        vector<double> waveSums;
+        parallelMapRowChunksInWaves<double>(employees.contents(), 4, 4096, sumOfSalaries, [&](const double sum){ waveSums.push_back(sum); });
+        CHECK_GT(waveSums.size(), 4);
+        CHECK_EQ(expected, accumulate(waveSums.begin(), waveSums.end(), 0.0));
+
+        vector<string_view> firstIds;
+        parallelMapRowChunksInWaves<string_view>(employees.contents(), 3, 4096, [](string_view rows){
+            return rows.substr(0, rows.find(','));
+        }, [&](const string_view id){ firstIds.push_back(id); });
+        CHECK_EQ(employees.contents().substr(0, firstIds[0].size()), firstIds[0]);
+        for(size_t chunk = 1; chunk < firstIds.size(); ++chunk) CHECK_LT(firstIds[chunk - 1].data(), firstIds[chunk].data());
+    }
+
+    filesystem::remove(path);
+}
+
+TEST_CASE("CSV ingestion throughput" * doctest::skip()){
+    const string path = (filesystem::temp_directory_path() / "employeesLarge.csv").string();
+    const size_t rows = writeEmployeesFile(path, 2000);
+    const size_t workers = max(1u, thread::hardware_concurrency());
+
+    const double expected = timePerUnit("getline loop: ", rows, "row", [&](){ return sumOfSalariesWithGetline(path); });
+    MappedFile employees(path);
+    CHECK_EQ(expected, timePerUnit("memory mapped reader: ", rows, "row", [&](){ return sumOfSalaries(employees.contents()); }));
+    CHECK_EQ(expected, timePerUnit("memory mapped reader, " + to_string(workers) + " workers: ", rows, "row", [&](){
+        auto partialSums = parallelMapRowChunks<double>(employees.contents(), workers, sumOfSalaries);
+        return accumulate(partialSums.begin(), partialSums.end(), 0.0);
+    }));
+
+    filesystem::remove(path);
+}
+
+TEST_CASE("Columnar employee table"){
+    MappedFile employees("./Employees.csv");
+    EmployeeTable table = EmployeeTable::fromCsv(employees.contents());
+
+    CHECK_EQ(1000, table.size());
+    CHECK_EQ(5, table.positions.size());
+    CHECK_EQ(4, table.seniorityLevels.size());
+    CHECK_EQ("51ef10eb-8c3b-4129-b844-542afaba7eeb", table.employeeIds[0]);
+    CHECK_EQ("De Vuyst", table.lastNames[0]);
+    CHECK_EQ("Manager", table.positions.decode(table.positionCodes[0]));
+    CHECK_EQ("Junior", table.seniorityLevels.decode(table.seniorityCodes[0]));
+    CHECK_EQ(4, table.yearsWorkedContinuously[0]);
+
+    const vector<double> salaries = computeSalariesColumnar(table);
+    CHECK_EQ(6279, salaries[0]);
+    for(size_t row = 0; row < table.size(); ++row){
+        if(salaries[row] != interpretedSalary(table, row)) FAIL("columnar salary differs at row " << row);
+    }
+
+    SUBCASE("years outside the lookup table use the interpreted rules"){
+        table.yearsWorkedContinuously[0] = 100;
+        table.yearsWorkedContinuously[1] = -3;
+        const vector<double> fixedUp = computeSalariesColumnar(table);
+        CHECK_EQ(interpretedSalary(table, 0), fixedUp[0]);
+        CHECK_EQ(interpretedSalary(table, 1), fixedUp[1]);
+    }
+}
+
+TEST_CASE("Columnar vs row at a time salary cost" * doctest::skip()){
+    const string path = (filesystem::temp_directory_path() / "employeesColumnar.csv").string();
+    const size_t rows = writeEmployeesFile(path, 2000);
+    MappedFile employees(path);
+
+    const double expected = timePerUnit("row at a time lambdas on CSV fields: ", rows, "row", [&](){ return sumOfSalaries(employees.contents()); });
+    EmployeeTable table;
+    timePerUnit("loading the columnar table: ", rows, "row", [&](){
+        table = EmployeeTable::fromCsv(employees.contents());
+    });
+    CHECK_EQ(expected, timePerUnit("columnar: ", rows, "row", [&](){
+        const vector<double> salaries = computeSalariesColumnar(table);
+        return accumulate(salaries.begin(), salaries.end(), 0.0);
+    }));
+
+    filesystem::remove(path);
+}
+
+TEST_CASE("Incremental salary recomputation"){
+    const string indexPath = (filesystem::temp_directory_path() / "salaryIndex.bin").string();
+    filesystem::remove(indexPath);
+    string employees =
+        "id,employee_id,First_name,Last_name,Seniority_level,Position,Years_worked_continuously,Special_bonus_level\n"
+        "1,a1,Carmine,De Vuyst,Junior,Manager,4,3\n"
+        "2,b2,Gasper,Feast,Entry,Team Leader,10,5\n"
+        "3,c3,Lin,Sunley,Senior,Tester,23,3\n";
+
+    SalaryIndex index = SalaryIndex::load(indexPath);
+    auto first = recomputeSalaries(employees, index);
+    CHECK_EQ(3, first.recomputed);
+    CHECK_EQ(3, first.changes.size());
+    CHECK_EQ(6279, first.salaries[0].salary);
+    CHECK_EQ(salaryFor("Tester", "Senior", "23", "3"), first.salaries[2].salary);
+    index.save(indexPath);
+
+    SUBCASE("unchanged input reuses every salary from the saved index"){
+        SalaryIndex reloaded = SalaryIndex::load(indexPath);
+        auto second = recomputeSalaries(employees, reloaded);
+        CHECK_EQ(0, second.recomputed);
+        CHECK_EQ(3, second.reused);
+        CHECK(second.changes.empty());
+        CHECK_EQ(6279, second.salaries[0].salary);
+    }
+
+    SUBCASE("changed, added and removed rows"){
+        string changed =
+            "id,employee_id,First_name,Last_name,Seniority_level,Position,Years_worked_continuously,Special_bonus_level\n"
+            "1,a1,Carmine,De Vuyst,Senior,Manager,4,3\n"
+            "2,c3,Lin,Sunley,Senior,Tester,23,3\n"
+            "3,d4,New,Hire,Entry,Analyst,0,0\n";
+        SalaryIndex reloaded = SalaryIndex::load(indexPath);
+        auto second = recomputeSalaries(changed, reloaded);
+        CHECK_EQ(2, second.recomputed);
+        CHECK_EQ(1, second.reused);
+        REQUIRE_EQ(3, second.changes.size());
+        CHECK_EQ("changed", nameOf(second.changes[0].kind));
+        CHECK_EQ("a1", second.changes[0].employeeId);
+        CHECK_EQ(6279, second.changes[0].oldSalary);
+        CHECK_EQ(salaryFor("Manager", "Senior", "4", "3"), second.changes[0].newSalary);
+        CHECK_EQ("added", nameOf(second.changes[1].kind));
+        CHECK_EQ(1600, second.changes[1].newSalary);
+        CHECK_EQ("removed", nameOf(second.changes[2].kind));
+        CHECK_EQ("b2", second.changes[2].employeeId);
+        CHECK_EQ(3, reloaded.rows.size());
+    }
+
+    SUBCASE("a changed rule invalidates exactly the rows that depend on it"){
+        SalaryRules rules;
+        rules.baseSalary = [](string_view position){ return (position == "Tester") ? 1700 : baseSalaryForPosition(position); };
+        SalaryIndex reloaded = SalaryIndex::load(indexPath);
+        auto second = recomputeSalaries(employees, reloaded, rules);
+        CHECK_EQ(1, second.recomputed);
+        REQUIRE_EQ(1, second.changes.size());
+        CHECK_EQ("rules changed", nameOf(second.changes[0].kind));
+        CHECK_EQ("c3", second.changes[0].employeeId);
+        CHECK_EQ(ceil(1.09 * 1700 * 1.5 * 2), second.salaries[2].salary);
+    }
+
+    SUBCASE("a length past the end of the file makes an empty index"){
+        {
+            ofstream corrupt(indexPath, ios::binary | ios::trunc);
+            const uint64_t ruleCount = 1;
+            const uint32_t length = 0xfffffff0;
+            corrupt.write(SalaryIndex::magic, sizeof(SalaryIndex::magic));
+            corrupt.write(reinterpret_cast<const char*>(&ruleCount), sizeof(ruleCount));
+            corrupt.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            corrupt << "short";
+        }
+        SalaryIndex reloaded = SalaryIndex::load(indexPath);
+        CHECK(reloaded.rows.empty());
+        CHECK(reloaded.ruleOutputs.empty());
+    }
+
+    filesystem::remove(indexPath);
+}
+
+TEST_CASE("Salary text output"){
+    string text;
+    appendSalary(text, 1500);
+    text.push_back(' ');
+    appendSalary(text, 12345678);
+    text.push_back(' ');
+    appendSalary(text, 1234.5);
+    text.push_back(' ');
+    appendInt(text, -42);
+    CHECK_EQ("1500 12345678 1234.5 -42", text);
+
+    const string path = (filesystem::temp_directory_path() / "salaries.txt").string();
+    const int descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    REQUIRE(descriptor >= 0);
+    {
+        TextWriter output(descriptor, 16);
+        output << "a1" << ',' << 6279.0 << '\n';
+        output << string(40, 'x') << '\n';
+        output << 7LL << '\n';
+    }
+    close(descriptor);
+
+    ifstream written(path);
+    const string contents((istreambuf_iterator<char>(written)), istreambuf_iterator<char>());
+    CHECK_EQ("a1,6279\n" + string(40, 'x') + "\n7\n", contents);
+    filesystem::remove(path);
+}
+
+TEST_CASE("Salary columns file"){
+    const string path = (filesystem::temp_directory_path() / "salaries.salcol").string();
+    SalaryColumnsWriter first;
+    first.add("a1", 6279);
+    first.add("", 1500);
+    SalaryColumnsWriter second;
+    second.add("c33", 2551.5);
+    first.append(second);
+    first.save(path);
+
+    SUBCASE("reads back in place"){
+        SalaryColumns columns(path);
+        REQUIRE_EQ(3, columns.size());
+        CHECK_EQ("a1", columns.employeeId(0));
+        CHECK_EQ("", columns.employeeId(1));
+        CHECK_EQ("c33", columns.employeeId(2));
+        CHECK_EQ(6279, columns.salary(0));
+        CHECK_EQ(2551.5, columns.salaries()[2]);
+        CHECK_EQ(0, reinterpret_cast<uintptr_t>(columns.salaries()) % alignof(double));
+    }
+
+    SUBCASE("written while the rows come in, the file is the same"){
+        const string streamedPath = path + ".streamed";
+        {
+            SalaryColumnsFileWriter file(streamedPath);
+            SalaryColumnsWriter firstRows;
+            firstRows.add("a1", 6279);
+            firstRows.add("", 1500);
+            file.append(firstRows);
+            file.append(second);
+            CHECK_EQ(3, file.size());
+            file.finish();
+        }
+        auto contentsOf = [](const string& file){
+            ifstream input(file, ios::binary);
+            return string((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+        };
+        CHECK_EQ(contentsOf(path), contentsOf(streamedPath));
+        CHECK_FALSE(filesystem::exists(streamedPath + ".tmp"));
+        filesystem::remove(streamedPath);
+    }
+
+    SUBCASE("an unfinished streamed file leaves nothing behind"){
+        const string streamedPath = path + ".unfinished";
+        {
+            SalaryColumnsFileWriter file(streamedPath);
+            file.append(second);
+        }
+        CHECK_FALSE(filesystem::exists(streamedPath));
+        CHECK_FALSE(filesystem::exists(streamedPath + ".tmp"));
+    }
+
+    SUBCASE("rejects files that are not salary columns"){
+        filesystem::resize_file(path, filesystem::file_size(path) - 1);
+        CHECK_THROWS_AS(SalaryColumns{path}, runtime_error);
+        ofstream(path) << "id,employee_id\n";
+        CHECK_THROWS_AS(SalaryColumns{path}, runtime_error);
+    }
+
+    SUBCASE("rejects id offsets out of order or past the ids"){
+        auto writeOffset = [&path](const size_t row, const uint64_t offset){
+            fstream file(path, ios::in | ios::out | ios::binary);
+            file.seekp(sizeof(SalaryColumnsHeader) + 3 * sizeof(double) + row * sizeof(uint64_t));
+            file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+        };
+        writeOffset(1, 100);
+        CHECK_THROWS_AS(SalaryColumns{path}, runtime_error);
+        writeOffset(1, 4);
+        CHECK_THROWS_AS(SalaryColumns{path}, runtime_error);
+        writeOffset(1, 2);
+        CHECK_EQ("a1", SalaryColumns{path}.employeeId(0));
+    }
+
+    filesystem::remove(path);
+}
+
+TEST_CASE("Salary output throughput" * doctest::skip()){
+    const size_t rows = 5000000;
+    const TimingOptions fewerRuns{1, 3};
+
+    timePerUnit("ofstream with endl: ", rows, "row", [&](){
+        ofstream output("/dev/null");
+        for(size_t row = 0; row < rows; ++row) output << "id" << row << "," << ceil(row * 1.5) << endl;
+    }, fewerRuns);
+    timePerUnit("TextWriter: ", rows, "row", [&](){
+        const int descriptor = open("/dev/null", O_WRONLY);
+        {
+            TextWriter output(descriptor);
+            for(size_t row = 0; row < rows; ++row) output << "id" << static_cast<long long>(row) << ',' << ceil(row * 1.5) << '\n';
+        }
+        close(descriptor);
+    }, fewerRuns);
+    const string path = (filesystem::temp_directory_path() / "salariesLarge.salcol").string();
+    timePerUnit("salary columns file: ", rows, "row", [&](){
+        SalaryColumnsWriter columns;
+        for(size_t row = 0; row < rows; ++row) columns.add("id" + to_string(row), ceil(row * 1.5));
+        columns.save(path);
+    }, fewerRuns);
+    timePerUnit("summing the mapped salary column: ", rows, "row", [&](){
+        SalaryColumns columns(path);
+        CHECK_EQ(doctest::Approx(1.5 * rows * (rows - 1) / 2).epsilon(0.001), accumulate(columns.salaries(), columns.salaries() + columns.size(), 0.0));
+    }, fewerRuns);
+    filesystem::remove(path);
+}
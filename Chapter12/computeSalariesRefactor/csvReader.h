@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Read only memory mapping of a whole file. Rows and fields handed out by the
+// reader point into it, so it has to outlive them.
+class MappedFile{
+    private:
+        int descriptor = -1;
+        void* address = nullptr;
+        size_t length = 0;
+
+    public:
+        explicit MappedFile(const string& path){
+            descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(descriptor < 0) throw runtime_error("cannot open " + path);
+            struct stat status;
+            if(fstat(descriptor, &status) != 0){
+                close(descriptor);
+                throw runtime_error("cannot stat " + path);
+            }
+            length = status.st_size;
+            if(length == 0) return;
+            address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if(address == MAP_FAILED){
+                close(descriptor);
+                throw runtime_error("cannot map " + path);
+            }
+            madvise(address, length, MADV_SEQUENTIAL);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile(){
+            if(address != nullptr) munmap(address, length);
+            if(descriptor >= 0) close(descriptor);
+        }
+
+        string_view contents() const{
+            return string_view(static_cast<const char*>(address), length);
+        }
+};
+
+#if defined(__SSE2__)
+inline unsigned bytesEqualTo(const char* position, const char character){
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(character))));
+}
+#endif
+
+inline size_t countQuotes(const char* position, const char* end){
+    size_t quotes = 0;
+#if defined(__SSE2__)
+    for(; end - position >= 16; position += 16) quotes += __builtin_popcount(bytesEqualTo(position, '"'));
+#endif
+    for(; position < end; ++position) quotes += (*position == '"');
+    return quotes;
+}
+
+// Returns the first newline at or after `position` that is not inside a quoted
+// field, or `end`. Sixteen bytes are checked at a time; only blocks holding a
+// newline or a quote are looked at byte by byte. A doubled quote inside a
+// quoted field toggles `inQuotes` twice, which leaves it as it was.
+inline const char* findRowEnd(const char* position, const char* end, bool& inQuotes){
+#if defined(__SSE2__)
+    for(; end - position >= 16; position += 16){
+        unsigned structural = bytesEqualTo(position, '\n') | bytesEqualTo(position, '"');
+        while(structural != 0){
+            const int offset = __builtin_ctz(structural);
+            structural &= structural - 1;
+            if(position[offset] == '"') inQuotes = !inQuotes;
+            else if(!inQuotes) return position + offset;
+        }
+    }
+#endif
+    for(; position < end; ++position){
+        if(*position == '"') inQuotes = !inQuotes;
+        else if(*position == '\n' && !inQuotes) return position;
+    }
+    return end;
+}
+
+// Splits one row into `fields`, reusing its storage. Quoted fields come out
+// without their surrounding quotes; doubled quotes inside them stay doubled,
+// unescapeField turns them into single ones when a field needs it.
+inline void splitFields(string_view row, vector<string_view>& fields){
+    fields.clear();
+    if(!row.empty() && row.back() == '\r') row.remove_suffix(1);
+    size_t position = 0;
+    while(true){
+        if(position < row.size() && row[position] == '"'){
+            size_t closing = position + 1;
+            while(closing < row.size()){
+                if(row[closing] == '"'){
+                    if(closing + 1 < row.size() && row[closing + 1] == '"') closing += 2;
+                    else break;
+                } else {
+                    ++closing;
+                }
+            }
+            fields.push_back(row.substr(position + 1, closing - position - 1));
+            position = row.find(',', closing);
+        } else {
+            const size_t comma = row.find(',', position);
+            fields.push_back(row.substr(position, (comma == string_view::npos) ? string_view::npos : comma - position));
+            position = comma;
+        }
+        if(position == string_view::npos) return;
+        ++position;
+    }
+}
+
+inline string unescapeField(const string_view field){
+    string result;
+    result.reserve(field.size());
+    for(size_t i = 0; i < field.size(); ++i){
+        result.push_back(field[i]);
+        if(field[i] == '"' && i + 1 < field.size() && field[i + 1] == '"') ++i;
+    }
+    return result;
+}
+
+// Calls f(fields) for every non empty row of `data`. `fields` is reused from row
+// to row, so nothing is allocated once it has grown to the widest row.
+template<typename F>
+size_t forEachRow(const string_view data, vector<string_view>& fields, F f){
+    const char* position = data.data();
+    const char* end = data.data() + data.size();
+    size_t rows = 0;
+    while(position < end){
+        bool inQuotes = false;
+        const char* rowEnd = findRowEnd(position, end, inQuotes);
+        const string_view row(position, rowEnd - position);
+        if(!row.empty() && row != "\r"){
+            splitFields(row, fields);
+            f(static_cast<const vector<string_view>&>(fields));
+            ++rows;
+        }
+        position = (rowEnd == end) ? end : rowEnd + 1;
+    }
+    return rows;
+}
+
+// Runs chunk(index) for every index in [0, count) on up to `workers` threads.
+template<typename F>
+void runOnThreads(const size_t count, const size_t workers, F chunk){
+    vector<thread> threads;
+    const size_t threadCount = max<size_t>(1, min(workers, count));
+    for(size_t worker = 1; worker < threadCount; ++worker){
+        threads.emplace_back([&, worker](){
+            for(size_t index = worker; index < count; index += threadCount) chunk(index);
+        });
+    }
+    for(size_t index = 0; index < count; index += threadCount) chunk(index);
+    for(auto& aThread : threads) aThread.join();
+}
+
+// Cuts `data` into `chunkCount` pieces that each hold whole rows. Whether a
+// newline ends a row depends on the number of quotes before it, so the quotes
+// of every nominal chunk are counted in parallel first; their prefix parity
+// tells each chunk whether it starts inside a quoted field, and the chunk then
+// moves its start to the end of the row it landed in.
+inline vector<string_view> splitIntoRowChunks(const string_view data, size_t chunkCount, const size_t workers = thread::hardware_concurrency()){
+    chunkCount = max<size_t>(1, min(chunkCount, data.size()));
+    vector<size_t> nominalStarts(chunkCount + 1);
+    for(size_t i = 0; i <= chunkCount; ++i) nominalStarts[i] = data.size() / chunkCount * i;
+    nominalStarts[chunkCount] = data.size();
+
+    vector<size_t> quotes(chunkCount);
+    runOnThreads(chunkCount, workers, [&](size_t index){
+        quotes[index] = countQuotes(data.data() + nominalStarts[index], data.data() + nominalStarts[index + 1]);
+    });
+
+    vector<size_t> starts(chunkCount + 1);
+    starts[chunkCount] = data.size();
+    size_t quotesBefore = 0;
+    for(size_t index = 0; index < chunkCount; ++index){
+        if(index == 0){
+            starts[index] = 0;
+        } else {
+            bool inQuotes = quotesBefore % 2 == 1;
+            const char* rowEnd = findRowEnd(data.data() + nominalStarts[index], data.data() + data.size(), inQuotes);
+            starts[index] = min(data.size(), static_cast<size_t>(rowEnd - data.data()) + 1);
+        }
+        quotesBefore += quotes[index];
+    }
+
+    vector<string_view> chunks;
+    for(size_t index = 0; index < chunkCount; ++index){
+        chunks.push_back(data.substr(starts[index], starts[index + 1] - starts[index]));
+    }
+    return chunks;
+}
+
+// Splits `data` into row aligned chunks, several per worker, and returns
+// f(chunk) for each of them in file order.
+template<typename Result, typename F>
+vector<Result> parallelMapRowChunks(const string_view data, const size_t workers, F f){
+    const size_t threadCount = max<size_t>(1, workers);
+    const vector<string_view> chunks = splitIntoRowChunks(data, threadCount * 4, threadCount);
+    vector<Result> results(chunks.size());
+    runOnThreads(chunks.size(), threadCount, [&](size_t index){ results[index] = f(chunks[index]); });
+    return results;
+}
+
+// parallelMapRowChunks for inputs whose results do not all fit in memory: the
+// chunks hold about `chunkBytes` each and are mapped one wave of `workers`
+// chunks at a time. consume(result) sees the results of a wave in file order
+// before the next wave starts, so only one wave of results is alive at a time.
+template<typename Result, typename F, typename Consume>
+void parallelMapRowChunksInWaves(const string_view data, const size_t workers, const size_t chunkBytes, F f, Consume consume){
+    const size_t threadCount = max<size_t>(1, workers);
+    const size_t chunkCount = max(threadCount, data.size() / max<size_t>(1, chunkBytes) + 1);
+    const vector<string_view> chunks = splitIntoRowChunks(data, chunkCount, threadCount);
+    for(size_t first = 0; first < chunks.size(); first += threadCount){
+        vector<Result> results(min(threadCount, chunks.size() - first));
+        runOnThreads(results.size(), threadCount, [&](size_t index){ results[index] = f(chunks[first + index]); });
+        for(Result& result : results) consume(move(result));
+    }
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "computeSalaries.h"
+#include "csvReader.h"
+
+using namespace std;
+
+// The four rules computeSalary combines, replaceable so a change to any of them
+// can be detected. Defaults are the lambdas of computeSalaries.h.
+struct SalaryRules{
+    function<int(string_view)> baseSalary = baseSalaryForPosition;
+    function<double(string_view)> seniorityFactor = factorForSeniority;
+    function<double(string_view)> continuityFactor = factorForContinuity;
+    function<double(string_view)> bonusFactor = [](string_view special_bonus_level){
+        return specialBonusFactor([&](){ return bonusLevel(special_bonus_level); });
+    };
+};
+
+struct FixedBaseSalary{
+    int value;
+    int baseSalaryForPosition() const{ return value; }
+};
+
+inline uint64_t fnv1a(const string_view bytes, uint64_t hash = 14695981039346656037ULL){
+    for(const char byte : bytes){
+        hash ^= static_cast<unsigned char>(byte);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+struct SalaryIndexEntry{
+    uint64_t rowHash;
+    double salary;
+};
+
+// What the last run saw: a hash and the salary of every employee, and the
+// output of every rule for every input value it was evaluated on, e.g.
+// "position=Tester" -> 1500. A row is only reused when its hash and all four
+// rule outputs it depends on are the same as then.
+struct SalaryIndex{
+    unordered_map<string, SalaryIndexEntry> rows;
+    unordered_map<string, double> ruleOutputs;
+
+    static constexpr char magic[8] = {'S', 'A', 'L', 'I', 'D', 'X', '0', '1'};
+
+    // A missing or unreadable index is an empty one: everything is recomputed.
+    static SalaryIndex load(const string& path){
+        SalaryIndex index;
+        ifstream input(path, ios::binary);
+        char header[sizeof(magic)];
+        if(!input.read(header, sizeof(header)) || !equal(header, header + sizeof(header), magic)) return index;
+
+        input.seekg(0, ios::end);
+        const streamoff fileSize = input.tellg();
+        input.seekg(sizeof(magic));
+
+        // A length past the end of the file is corruption, not a string to allocate.
+        auto readString = [&input, fileSize](string& value){
+            uint32_t length = 0;
+            if(!input.read(reinterpret_cast<char*>(&length), sizeof(length))) return false;
+            if(length > fileSize - input.tellg()){
+                input.setstate(ios::failbit);
+                return false;
+            }
+            value.resize(length);
+            return static_cast<bool>(input.read(value.data(), length));
+        };
+        uint64_t ruleCount = 0;
+        uint64_t rowCount = 0;
+        input.read(reinterpret_cast<char*>(&ruleCount), sizeof(ruleCount));
+        for(uint64_t i = 0; input && i < ruleCount; ++i){
+            string key;
+            double output;
+            if(readString(key) && input.read(reinterpret_cast<char*>(&output), sizeof(output))) index.ruleOutputs.emplace(move(key), output);
+        }
+        input.read(reinterpret_cast<char*>(&rowCount), sizeof(rowCount));
+        for(uint64_t i = 0; input && i < rowCount; ++i){
+            string employeeId;
+            SalaryIndexEntry entry;
+            if(readString(employeeId) && input.read(reinterpret_cast<char*>(&entry), sizeof(entry))) index.rows.emplace(move(employeeId), entry);
+        }
+        if(!input) return SalaryIndex();
+        return index;
+    }
+
+    // Written next to the old index and renamed over it, so a crash leaves
+    // either the old or the new index behind.
+    void save(const string& path) const{
+        const string temporaryPath = path + ".tmp";
+        {
+            ofstream output(temporaryPath, ios::binary | ios::trunc);
+            auto writeString = [&output](const string& value){
+                const uint32_t length = value.size();
+                output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                output.write(value.data(), length);
+            };
+            output.write(magic, sizeof(magic));
+            const uint64_t ruleCount = ruleOutputs.size();
+            output.write(reinterpret_cast<const char*>(&ruleCount), sizeof(ruleCount));
+            for(const auto& [key, value] : ruleOutputs){
+                writeString(key);
+                output.write(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+            const uint64_t rowCount = rows.size();
+            output.write(reinterpret_cast<const char*>(&rowCount), sizeof(rowCount));
+            for(const auto& [employeeId, entry] : rows){
+                writeString(employeeId);
+                output.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            }
+            if(!output.flush()) throw runtime_error("cannot write " + temporaryPath);
+        }
+        if(rename(temporaryPath.c_str(), path.c_str()) != 0) throw runtime_error("cannot replace " + path);
+    }
+};
+
+enum class SalaryChangeKind{ Added, Changed, RulesChanged, Removed };
+
+struct SalaryChange{
+    SalaryChangeKind kind;
+    string employeeId;
+    double oldSalary;
+    double newSalary;
+};
+
+struct EmployeeSalary{
+    string employeeId;
+    double salary;
+};
+
+struct IncrementalSalaries{
+    vector<EmployeeSalary> salaries;
+    vector<SalaryChange> changes;
+    size_t recomputed = 0;
+    size_t reused = 0;
+};
+
+// Brings `index` up to date with the rows in `data` and returns every salary,
+// in file order, and what changed since the index was written. Each rule is
+// evaluated once per distinct input value of this run; a row whose hash and
+// rule outputs are unchanged keeps its salary without going through computeSalary.
+inline IncrementalSalaries recomputeSalaries(const string_view data, SalaryIndex& index, const SalaryRules& rules = SalaryRules()){
+    IncrementalSalaries result;
+    unordered_map<string, double> ruleOutputs;
+    unordered_set<string> seen;
+    string key;
+
+    auto ruleOutput = [&](const char* rule, const string_view value, const function<double(string_view)>& evaluate){
+        key.assign(rule).append("=").append(value);
+        auto found = ruleOutputs.find(key);
+        if(found == ruleOutputs.end()) found = ruleOutputs.emplace(key, evaluate(value)).first;
+        const auto previous = index.ruleOutputs.find(key);
+        const bool unchanged = previous != index.ruleOutputs.end() && previous->second == found->second;
+        return make_pair(found->second, unchanged);
+    };
+
+    vector<string_view> fields;
+    forEachRow(data, fields, [&](const vector<string_view>& row){
+        if(row.size() < 8 || row[0] == "id") return;
+        string employeeId(row[1]);
+        uint64_t rowHash = fnv1a(row[1]);
+        for(size_t field = 2; field < 8; ++field) rowHash = fnv1a(row[field], fnv1a("\x1f", rowHash));
+
+        const auto [base, baseUnchanged] = ruleOutput("position", row[5], [&rules](string_view position){ return rules.baseSalary(position); });
+        const auto [seniority, seniorityUnchanged] = ruleOutput("seniority", row[4], rules.seniorityFactor);
+        const auto [continuity, continuityUnchanged] = ruleOutput("years", row[6], rules.continuityFactor);
+        const auto [bonus, bonusUnchanged] = ruleOutput("bonus", row[7], rules.bonusFactor);
+        const bool rulesUnchanged = baseUnchanged && seniorityUnchanged && continuityUnchanged && bonusUnchanged;
+
+        const auto previous = index.rows.find(employeeId);
+        double salary;
+        if(previous != index.rows.end() && previous->second.rowHash == rowHash && rulesUnchanged){
+            salary = previous->second.salary;
+            ++result.reused;
+        } else {
+            salary = computeSalary(
+                    FixedBaseSalary{static_cast<int>(base)},
+                    [seniority = seniority](){ return seniority; },
+                    [continuity = continuity](){ return continuity; },
+                    [bonus = bonus](){ return bonus; }
+                );
+            ++result.recomputed;
+            if(previous == index.rows.end()){
+                result.changes.push_back({SalaryChangeKind::Added, employeeId, 0, salary});
+            } else {
+                const SalaryChangeKind kind = (previous->second.rowHash == rowHash) ? SalaryChangeKind::RulesChanged : SalaryChangeKind::Changed;
+                result.changes.push_back({kind, employeeId, previous->second.salary, salary});
+            }
+        }
+        index.rows[employeeId] = SalaryIndexEntry{rowHash, salary};
+        result.salaries.push_back({employeeId, salary});
+        seen.insert(move(employeeId));
+    });
+
+    for(auto row = index.rows.begin(); row != index.rows.end();){
+        if(seen.count(row->first) == 0){
+            result.changes.push_back({SalaryChangeKind::Removed, row->first, row->second.salary, 0});
+            row = index.rows.erase(row);
+        } else {
+            ++row;
+        }
+    }
+    index.ruleOutputs = move(ruleOutputs);
+    return result;
+}
+
+inline string nameOf(const SalaryChangeKind kind){
+    switch(kind){
+        case SalaryChangeKind::Added: return "added";
+        case SalaryChangeKind::Changed: return "changed";
+        case SalaryChangeKind::RulesChanged: return "rules changed";
+        case SalaryChangeKind::Removed: return "removed";
+    }
+    return "";
+}
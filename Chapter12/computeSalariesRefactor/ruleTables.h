@@ -0,0 +1,195 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Rules as data: lookups built by the compiler that replace chains of ifs.
+// Neither kind of table makes up a value for an input it does not know; the
+// caller says what happens then, through find(), valueOr() or at().
+
+template<typename Value>
+struct KeyRule{
+    string_view key;
+    Value value;
+};
+
+template<typename Value>
+struct IntervalRule{
+    int from;
+    Value value;
+};
+
+// Hash of the whole key, for keys the cheap hash below cannot tell apart.
+constexpr uint32_t ruleKeyHash(const string_view key, const uint32_t seed){
+    uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+    for(const char character : key){
+        hash ^= static_cast<unsigned char>(character);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+// Hash of the length and the first and last bytes only: a few instructions
+// whatever the length of the key, and enough to tell short labels apart.
+constexpr uint32_t ruleKeyShapeHash(const string_view key, const uint32_t seed){
+    const uint32_t first = key.empty() ? 0 : static_cast<unsigned char>(key.front());
+    const uint32_t last = key.empty() ? 0 : static_cast<unsigned char>(key.back());
+    const uint32_t hash = ((static_cast<uint32_t>(key.size()) | first << 8 | last << 16) + seed) * 0x9e3779b1u;
+    return hash ^ (hash >> 16);
+}
+
+constexpr size_t nextPowerOfTwo(const size_t value){
+    size_t power = 1;
+    while(power < value) power *= 2;
+    return power;
+}
+
+// A string to value map with a seed chosen at compile time so that every key
+// lands in its own slot. A lookup is one hash, one mask and one string
+// comparison, whichever key it is and however many keys there are. The hash
+// only reads the length and the first and last bytes of the key, unless two
+// keys agree on all three; then it reads the whole key.
+template<typename Value, size_t N>
+class PerfectHashTable{
+    public:
+        static constexpr size_t slots = nextPowerOfTwo(2 * N);
+
+    private:
+        uint32_t seed = 0;
+        bool wholeKey = false;
+        array<string_view, slots> keys{};
+        array<Value, slots> values{};
+        array<bool, slots> occupied{};
+
+        constexpr size_t slotFor(const string_view key) const{
+            return (wholeKey ? ruleKeyHash(key, seed) : ruleKeyShapeHash(key, seed)) & (slots - 1);
+        }
+
+        constexpr bool placeAll(const KeyRule<Value> (&rules)[N]){
+            occupied = array<bool, slots>{};
+            for(size_t rule = 0; rule < N; ++rule){
+                const size_t slot = slotFor(rules[rule].key);
+                if(occupied[slot]){
+                    if(keys[slot] == rules[rule].key) throw logic_error("duplicate key in a rule table");
+                    return false;
+                }
+                occupied[slot] = true;
+                keys[slot] = rules[rule].key;
+                values[slot] = rules[rule].value;
+            }
+            return true;
+        }
+
+        static constexpr bool sameShape(const string_view first, const string_view second){
+            return first.size() == second.size() && (first.empty() || (first.front() == second.front() && first.back() == second.back()));
+        }
+
+        static constexpr bool shapesDiffer(const KeyRule<Value> (&rules)[N]){
+            for(size_t rule = 0; rule < N; ++rule){
+                for(size_t other = rule + 1; other < N; ++other){
+                    if(sameShape(rules[rule].key, rules[other].key)) return false;
+                }
+            }
+            return true;
+        }
+
+    public:
+        constexpr explicit PerfectHashTable(const KeyRule<Value> (&rules)[N]){
+            for(const bool hashWholeKey : {false, true}){
+                if(!hashWholeKey && !shapesDiffer(rules)) continue;
+                wholeKey = hashWholeKey;
+                for(uint32_t candidate = 0; candidate < 65536; ++candidate){
+                    seed = candidate;
+                    if(placeAll(rules)) return;
+                }
+            }
+            throw logic_error("no perfect hash seed for the rule table");
+        }
+
+        // Whether lookups hash the whole key.
+        constexpr bool hashesWholeKey() const{
+            return wholeKey;
+        }
+
+        // nullptr for an unknown key.
+        constexpr const Value* find(const string_view key) const{
+            const size_t slot = slotFor(key);
+            return (occupied[slot] && keys[slot] == key) ? &values[slot] : nullptr;
+        }
+
+        constexpr Value valueOr(const string_view key, const Value fallback) const{
+            const Value* found = find(key);
+            return (found == nullptr) ? fallback : *found;
+        }
+
+        Value at(const string_view key) const{
+            const Value* found = find(key);
+            if(found == nullptr) throw out_of_range("no rule for " + string(key));
+            return *found;
+        }
+
+        constexpr bool contains(const string_view key) const{
+            return find(key) != nullptr;
+        }
+
+        constexpr size_t size() const{
+            return N;
+        }
+};
+
+template<typename Value, size_t N>
+constexpr PerfectHashTable<Value, N> makePerfectHashTable(const KeyRule<Value> (&rules)[N]){
+    return PerfectHashTable<Value, N>(rules);
+}
+
+// Half open ranges of ints, each starting at `from` and ending where the next
+// one starts; the last one is open ended. A lookup counts the bounds at or
+// below the input, which compiles to N comparisons and additions and no jumps.
+// Inputs below the first bound are unknown.
+template<typename Value, size_t N>
+class IntervalTable{
+    private:
+        array<int, N> bounds{};
+        array<Value, N> values{};
+
+    public:
+        constexpr explicit IntervalTable(const IntervalRule<Value> (&rules)[N]){
+            for(size_t rule = 0; rule < N; ++rule){
+                if(rule > 0 && rules[rule].from <= rules[rule - 1].from) throw logic_error("interval rules must be in increasing order");
+                bounds[rule] = rules[rule].from;
+                values[rule] = rules[rule].value;
+            }
+        }
+
+        constexpr const Value* find(const int input) const{
+            size_t interval = 0;
+            for(size_t rule = 1; rule < N; ++rule) interval += (input >= bounds[rule]);
+            return (input >= bounds[0]) ? &values[interval] : nullptr;
+        }
+
+        constexpr Value valueOr(const int input, const Value fallback) const{
+            const Value* found = find(input);
+            return (found == nullptr) ? fallback : *found;
+        }
+
+        Value at(const int input) const{
+            const Value* found = find(input);
+            if(found == nullptr) throw out_of_range("no rule for " + to_string(input));
+            return *found;
+        }
+};
+
+template<typename Value, size_t N>
+constexpr IntervalTable<Value, N> makeIntervalTable(const IntervalRule<Value> (&rules)[N]){
+    return IntervalTable<Value, N>(rules);
+}
+
+// Covers every int: the first interval starts at the smallest one.
+constexpr int fromLowest = numeric_limits<int>::min();
@@ -0,0 +1,323 @@
+#pragma once
+
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "csvReader.h"
+
+using namespace std;
+
+// Formatting straight into a string with to_chars: no locale, no stream state.
+inline void appendInt(string& output, const long long value){
+    char digits[24];
+    const auto result = to_chars(digits, digits + sizeof(digits), value);
+    output.append(digits, result.ptr - digits);
+}
+
+// Salaries are whole numbers after ceil and are written as such; anything else
+// gets the shortest representation that reads back as the same double.
+inline void appendSalary(string& output, const double salary){
+    if(salary == floor(salary) && fabs(salary) < 9e18) return appendInt(output, static_cast<long long>(salary));
+    char digits[32];
+    const auto result = to_chars(digits, digits + sizeof(digits), salary);
+    output.append(digits, result.ptr - digits);
+}
+
+inline void writeAll(const int descriptor, const char* data, size_t size){
+    while(size > 0){
+        const ssize_t written = ::write(descriptor, data, size);
+        if(written < 0 && errno == EINTR) continue;
+        if(written <= 0) throw runtime_error(string("cannot write output: ") + strerror(errno));
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+// Collects text in one large buffer and hands it to write(2) only when the
+// buffer is full or on flush(); never once per row. Pieces larger than the
+// buffer, such as the output of a whole worker, go out directly. Call flush()
+// at the end: the destructor flushes too, but cannot report a failed write.
+class TextWriter{
+    private:
+        int descriptor;
+        size_t capacity;
+        string buffer;
+
+    public:
+        explicit TextWriter(const int descriptor = STDOUT_FILENO, const size_t capacity = 1 << 20) : descriptor(descriptor), capacity(capacity){
+            buffer.reserve(capacity);
+        }
+
+        TextWriter(const TextWriter&) = delete;
+        TextWriter& operator=(const TextWriter&) = delete;
+
+        ~TextWriter(){
+            try{
+                flush();
+            } catch(const runtime_error&){
+            }
+        }
+
+        TextWriter& operator<<(const string_view text){
+            if(buffer.size() + text.size() > capacity) flush();
+            if(text.size() >= capacity) writeAll(descriptor, text.data(), text.size());
+            else buffer.append(text);
+            return *this;
+        }
+
+        TextWriter& operator<<(const char character){
+            if(buffer.size() + 1 > capacity) flush();
+            buffer.push_back(character);
+            return *this;
+        }
+
+        TextWriter& operator<<(const long long value){
+            if(buffer.size() + 24 > capacity) flush();
+            appendInt(buffer, value);
+            return *this;
+        }
+
+        TextWriter& operator<<(const double salary){
+            if(buffer.size() + 32 > capacity) flush();
+            appendSalary(buffer, salary);
+            return *this;
+        }
+
+        void flush(){
+            writeAll(descriptor, buffer.data(), buffer.size());
+            buffer.clear();
+        }
+};
+
+// Salaries as columns in one file that a later job maps and reads in place:
+//
+//   header        magic "SALCOL01", uint64 rows, uint64 id bytes
+//   salaries      double[rows]
+//   id offsets    uint64[rows + 1], where id i is bytes [offset i, offset i+1)
+//   ids           char[id bytes]
+//
+// The header is 24 bytes, so both numeric columns are 8 byte aligned in the
+// mapping. Numbers are in the byte order of the machine that wrote the file.
+struct SalaryColumnsHeader{
+    char magic[8];
+    uint64_t rows;
+    uint64_t idBytes;
+};
+
+const char salaryColumnsMagic[8] = {'S', 'A', 'L', 'C', 'O', 'L', '0', '1'};
+
+class SalaryColumnsWriter{
+    private:
+        vector<double> salaries;
+        vector<uint64_t> idOffsets{0};
+        string ids;
+
+        friend class SalaryColumnsFileWriter;
+
+    public:
+        void add(const string_view employeeId, const double salary){
+            salaries.push_back(salary);
+            ids.append(employeeId);
+            idOffsets.push_back(ids.size());
+        }
+
+        // Appends another writer's rows after these, e.g. to join per worker results.
+        void append(const SalaryColumnsWriter& other){
+            const uint64_t base = ids.size();
+            salaries.insert(salaries.end(), other.salaries.begin(), other.salaries.end());
+            for(size_t row = 1; row < other.idOffsets.size(); ++row) idOffsets.push_back(base + other.idOffsets[row]);
+            ids.append(other.ids);
+        }
+
+        size_t size() const{
+            return salaries.size();
+        }
+
+        // Written next to `path` and renamed over it, so readers never map a
+        // half written file.
+        void save(const string& path) const{
+            const string temporaryPath = path + ".tmp";
+            const int descriptor = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if(descriptor < 0) throw runtime_error("cannot create " + temporaryPath);
+            try{
+                SalaryColumnsHeader header;
+                memcpy(header.magic, salaryColumnsMagic, sizeof(header.magic));
+                header.rows = salaries.size();
+                header.idBytes = ids.size();
+                writeAll(descriptor, reinterpret_cast<const char*>(&header), sizeof(header));
+                writeAll(descriptor, reinterpret_cast<const char*>(salaries.data()), salaries.size() * sizeof(double));
+                writeAll(descriptor, reinterpret_cast<const char*>(idOffsets.data()), idOffsets.size() * sizeof(uint64_t));
+                writeAll(descriptor, ids.data(), ids.size());
+            } catch(...){
+                close(descriptor);
+                throw;
+            }
+            if(close(descriptor) != 0) throw runtime_error("cannot write " + temporaryPath);
+            if(rename(temporaryPath.c_str(), path.c_str()) != 0) throw runtime_error("cannot replace " + path);
+        }
+};
+
+// The same file as SalaryColumnsWriter::save, written while the rows are still
+// coming, for inputs too large to hold every row. Salaries go straight to the
+// file, after room for the header; id offsets and ids go to two unlinked spill
+// files that finish() appends once the number of rows is known. Nothing is
+// kept in memory but the rows of the SalaryColumnsWriter being appended.
+class SalaryColumnsFileWriter{
+    private:
+        string path;
+        string temporaryPath;
+        int descriptor = -1;
+        int offsetsDescriptor = -1;
+        int idsDescriptor = -1;
+        uint64_t rows = 0;
+        uint64_t idBytes = 0;
+
+        static int createSpill(const string& spillPath){
+            const int spill = open(spillPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+            if(spill < 0) throw runtime_error("cannot create " + spillPath);
+            unlink(spillPath.c_str());
+            return spill;
+        }
+
+        void copySpill(const int spill){
+            if(lseek(spill, 0, SEEK_SET) != 0) throw runtime_error("cannot rewind a spill file of " + temporaryPath);
+            vector<char> buffer(1 << 20);
+            while(true){
+                const ssize_t bytes = ::read(spill, buffer.data(), buffer.size());
+                if(bytes < 0 && errno == EINTR) continue;
+                if(bytes < 0) throw runtime_error("cannot read a spill file of " + temporaryPath);
+                if(bytes == 0) return;
+                writeAll(descriptor, buffer.data(), static_cast<size_t>(bytes));
+            }
+        }
+
+        void closeAll(){
+            for(int* opened : {&descriptor, &offsetsDescriptor, &idsDescriptor}){
+                if(*opened >= 0) close(*opened);
+                *opened = -1;
+            }
+        }
+
+    public:
+        explicit SalaryColumnsFileWriter(const string& path) : path(path), temporaryPath(path + ".tmp"){
+            descriptor = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if(descriptor < 0) throw runtime_error("cannot create " + temporaryPath);
+            try{
+                offsetsDescriptor = createSpill(path + ".offsets.tmp");
+                idsDescriptor = createSpill(path + ".ids.tmp");
+                const SalaryColumnsHeader placeholder{};
+                writeAll(descriptor, reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+                const uint64_t firstOffset = 0;
+                writeAll(offsetsDescriptor, reinterpret_cast<const char*>(&firstOffset), sizeof(firstOffset));
+            } catch(...){
+                closeAll();
+                unlink(temporaryPath.c_str());
+                throw;
+            }
+        }
+
+        SalaryColumnsFileWriter(const SalaryColumnsFileWriter&) = delete;
+        SalaryColumnsFileWriter& operator=(const SalaryColumnsFileWriter&) = delete;
+
+        // A writer destroyed before finish() leaves no file behind.
+        ~SalaryColumnsFileWriter(){
+            if(descriptor < 0) return;
+            closeAll();
+            unlink(temporaryPath.c_str());
+        }
+
+        // Appends the rows of `columns` after those appended before.
+        void append(const SalaryColumnsWriter& columns){
+            vector<uint64_t> offsets(columns.idOffsets.begin() + 1, columns.idOffsets.end());
+            for(uint64_t& offset : offsets) offset += idBytes;
+            writeAll(descriptor, reinterpret_cast<const char*>(columns.salaries.data()), columns.salaries.size() * sizeof(double));
+            writeAll(offsetsDescriptor, reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+            writeAll(idsDescriptor, columns.ids.data(), columns.ids.size());
+            rows += columns.size();
+            idBytes += columns.ids.size();
+        }
+
+        size_t size() const{
+            return rows;
+        }
+
+        // Completes the file and renames it over `path`.
+        void finish(){
+            copySpill(offsetsDescriptor);
+            copySpill(idsDescriptor);
+            SalaryColumnsHeader header;
+            memcpy(header.magic, salaryColumnsMagic, sizeof(header.magic));
+            header.rows = rows;
+            header.idBytes = idBytes;
+            if(pwrite(descriptor, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) throw runtime_error("cannot write " + temporaryPath);
+            const int written = descriptor;
+            descriptor = -1;
+            closeAll();
+            if(close(written) != 0){
+                unlink(temporaryPath.c_str());
+                throw runtime_error("cannot write " + temporaryPath);
+            }
+            if(rename(temporaryPath.c_str(), path.c_str()) != 0){
+                unlink(temporaryPath.c_str());
+                throw runtime_error("cannot replace " + path);
+            }
+        }
+};
+
+// A mapped salary columns file. Opening it checks the header against the file
+// size; after that every access is a load from the mapping, nothing is parsed.
+class SalaryColumns{
+    private:
+        MappedFile file;
+        size_t rows = 0;
+        const double* salaryColumn = nullptr;
+        const uint64_t* idOffsets = nullptr;
+        const char* ids = nullptr;
+
+    public:
+        explicit SalaryColumns(const string& path) : file(path){
+            const string_view data = file.contents();
+            SalaryColumnsHeader header;
+            if(data.size() < sizeof(header)) throw runtime_error(path + " is not a salary columns file");
+            memcpy(&header, data.data(), sizeof(header));
+            if(memcmp(header.magic, salaryColumnsMagic, sizeof(header.magic)) != 0) throw runtime_error(path + " is not a salary columns file");
+            if(header.rows > data.size() / 16 || header.idBytes > data.size() || sizeof(header) + header.rows * 16 + 8 + header.idBytes != data.size()){
+                throw runtime_error(path + " is truncated or corrupt");
+            }
+            rows = header.rows;
+            salaryColumn = reinterpret_cast<const double*>(data.data() + sizeof(header));
+            idOffsets = reinterpret_cast<const uint64_t*>(salaryColumn + rows);
+            ids = reinterpret_cast<const char*>(idOffsets + rows + 1);
+            // employeeId() trusts the offsets, so they are checked once here:
+            // from 0 up to idBytes, never decreasing.
+            if(idOffsets[0] != 0 || idOffsets[rows] != header.idBytes) throw runtime_error(path + " is truncated or corrupt");
+            for(size_t row = 0; row < rows; ++row){
+                if(idOffsets[row] > idOffsets[row + 1]) throw runtime_error(path + " is truncated or corrupt");
+            }
+        }
+
+        size_t size() const{
+            return rows;
+        }
+
+        const double* salaries() const{
+            return salaryColumn;
+        }
+
+        double salary(const size_t row) const{
+            return salaryColumn[row];
+        }
+
+        string_view employeeId(const size_t row) const{
+            return string_view(ids + idOffsets[row], idOffsets[row + 1] - idOffsets[row]);
+        }
+};
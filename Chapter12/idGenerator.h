@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+// Ids [first, end).
+struct IdBlock{
+    uint64_t first;
+    uint64_t end;
+
+    size_t size() const{
+        return end - first;
+    }
+};
+
+// The one shared counter. Threads take whole blocks from it, so there is one
+// atomic add per block instead of one per id, and no two blocks overlap.
+class IdSource{
+    private:
+        atomic<uint64_t> next;
+        const size_t blockSize;
+
+    public:
+        explicit IdSource(const uint64_t firstId = 1, const size_t blockSize = 1024) : next(firstId), blockSize(blockSize){
+            if(blockSize == 0) throw invalid_argument("ids are reserved in blocks of at least one");
+        }
+
+        IdSource(const IdSource&) = delete;
+        IdSource& operator=(const IdSource&) = delete;
+
+        IdBlock reserve(const size_t count){
+            const uint64_t first = next.fetch_add(count, memory_order_relaxed);
+            return IdBlock{first, first + count};
+        }
+
+        IdBlock reserveBlock(){
+            return reserve(blockSize);
+        }
+
+        // The first id never handed out.
+        uint64_t peek() const{
+            return next.load(memory_order_relaxed);
+        }
+};
+
+// An auto increment value in the style of initAutoIncrement: nextId(state)
+// returns the following state and leaves `state` as it was. Behind it is a
+// block of ids reserved for whoever holds the state; a new block is taken from
+// the source only when this one runs out. It is three words and copying it
+// copies no function. Give each thread its own state: ids are then unique
+// across threads without any contention, and dense except for the unused end
+// of the block a thread holds when it drops its state.
+struct IdState{
+    IdSource* source;
+    uint64_t id;
+    uint64_t end;
+};
+
+inline IdState initIds(IdSource& source){
+    const IdBlock block = source.reserveBlock();
+    return IdState{&source, block.first, block.end};
+}
+
+inline IdState nextId(const IdState& state){
+    if(state.id + 1 < state.end) return IdState{state.source, state.id + 1, state.end};
+    const IdBlock block = state.source->reserveBlock();
+    return IdState{state.source, block.first, block.end};
+}
+
+struct IdBatch{
+    IdBlock ids;
+    IdState next;
+};
+
+// `count` consecutive ids at once, taken after the current one: from the
+// state's own block when there are enough left, otherwise straight from the
+// source, so a large batch never throws away the rest of the block.
+inline IdBatch takeIds(const IdState& state, const size_t count){
+    if(state.end - state.id - 1 >= count){
+        const IdBlock ids{state.id + 1, state.id + 1 + count};
+        return IdBatch{ids, IdState{state.source, ids.end - 1, state.end}};
+    }
+    return IdBatch{state.source->reserve(count), state};
+}
@@ -7,6 +7,8 @@
 #include <optional>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "monadic.h"
+#include "timing.h"
 
 using namespace std;
 using namespace std::placeholders;
@@ -109,3 +111,158 @@ TEST_CASE("Compute with Maybe monad"){
     cout << "Result of 2 / 0 = " << to_string(Maybe<int>{2}.apply(divideEvenWith0, 0)) << endl;
 }
 
+TEST_CASE("and_then, transform and or_else on optional"){
+    auto divideEvenWith0 = [](const int first, const int second) -> optional<int>{
+        return (second == 0) ? nullopt : make_optional(first / second);
+    };
+    auto half = [&](const int value){ return divideEvenWith0(value, 2); };
+    auto divideTenBy = [&](const int value){ return divideEvenWith0(10, value); };
+    auto increment = [](const int value){ return value + 1; };
+
+    CHECK_EQ(optional{3}, transform(and_then(optional{4}, half), increment));
+    CHECK_EQ(nullopt, and_then(optional{0}, divideTenBy));
+    CHECK_EQ(nullopt, transform(optional<int>(), increment));
+    CHECK_EQ(optional{-1}, or_else(and_then(optional{0}, divideTenBy), [](){ return optional{-1}; }));
+    CHECK_EQ(optional{5}, or_else(optional{5}, [](){ return optional{-1}; }));
+    CHECK_EQ("2.5", transform(optional{5}, [](int value){ return to_string(value / 2) + ".5"; }).value());
+}
+
+TEST_CASE("expected carries the error"){
+    auto divide = [](const int first, const int second) -> expected<int, string>{
+        if(second == 0) return makeUnexpected("division of " + to_string(first) + " by 0");
+        return first / second;
+    };
+    auto divideTenBy = [&](const int value){ return divide(10, value); };
+
+    const expected<int, string> five = divideTenBy(2);
+    CHECK(five.has_value());
+    CHECK_EQ(5, five.value());
+    CHECK_EQ(6, transform(five, [](int value){ return value + 1; }).value());
+
+    const auto failed = and_then(expected<int, string>(0), divideTenBy);
+    CHECK_FALSE(failed.has_value());
+    CHECK_EQ("division of 10 by 0", failed.error());
+    CHECK_EQ(42, failed.value_or(42));
+    CHECK_THROWS_AS(failed.value(), BadExpectedAccess<string>);
+    CHECK_EQ("division of 10 by 0", transform(failed, [](int value){ return value + 1; }).error());
+    CHECK_EQ(7, or_else(failed, [](const string& error){ return expected<int, string>(static_cast<int>(error.size()) - 12); }).value());
+
+    const expected<int, int> errorOfSameType = makeUnexpected(3);
+    CHECK_FALSE(errorOfSameType.has_value());
+    CHECK_EQ(3, errorOfSameType.error());
+}
+
+TEST_CASE("chain stops at the first failure"){
+    int stagesRun = 0;
+    auto parse = [&](const string& text) -> optional<int>{
+        ++stagesRun;
+        if(text.empty() || text.find_first_not_of("0123456789") != string::npos) return nullopt;
+        return stoi(text);
+    };
+    auto reciprocalPercent = [&](const int value) -> optional<int>{
+        ++stagesRun;
+        return (value == 0) ? nullopt : make_optional(100 / value);
+    };
+    auto twice = [&](const int value){
+        ++stagesRun;
+        return 2 * value;
+    };
+
+    auto pipeline = chain(parse, reciprocalPercent, twice);
+    CHECK_EQ(optional{40}, pipeline("5"));
+    CHECK_EQ(3, stagesRun);
+
+    stagesRun = 0;
+    CHECK_EQ(nullopt, pipeline("x"));
+    CHECK_EQ(1, stagesRun);
+
+    stagesRun = 0;
+    CHECK_EQ(nullopt, pipeline("0"));
+    CHECK_EQ(2, stagesRun);
+
+    auto checked = chain([](const int value) -> expected<int, string>{
+        if(value < 0) return makeUnexpected(string("negative"));
+        return value;
+    }, twice, [](const int value) -> expected<int, string>{
+        if(value > 100) return makeUnexpected(string("too large"));
+        return value;
+    });
+    CHECK_EQ(20, checked(10).value());
+    CHECK_EQ("negative", checked(-1).error());
+    CHECK_EQ("too large", checked(51).error());
+}
+
+TEST_CASE("Optionals in batches with a validity mask"){
+    const auto first = MaybeBatch<int>::fromOptionals({6, nullopt, 9, 12, 7});
+    const auto second = MaybeBatch<int>::fromOptionals({2, 3, 0, nullopt, 7});
+
+    const auto divisors = filterBatch(second, [](int value){ return value != 0; }, 1);
+    const auto quotients = combineBatch(first, divisors, [](int dividend, int divisor){ return dividend / divisor; });
+    const auto incremented = transformBatch(quotients, [](int value){ return value + 1; });
+
+    CHECK_EQ(vector<optional<int>>{4, nullopt, nullopt, nullopt, 2}, incremented.toOptionals());
+
+    MaybeBatch<int> inPlace;
+    combineBatch(first, second, plus<int>(), inPlace);
+    filterBatch(inPlace, [](int value){ return value % 2 == 0; }, 0, inPlace);
+    transformBatch(inPlace, [](int value){ return value / 2; }, inPlace);
+    CHECK_EQ(vector<optional<int>>{4, nullopt, nullopt, nullopt, 7}, inPlace.toOptionals());
+    CHECK_THROWS_AS(combineBatch(first, MaybeBatch<int>(), plus<int>()), invalid_argument);
+}
+
+TEST_CASE("Optional pipeline cost" * doctest::skip()){
+    const size_t lanes = 10000000;
+    vector<optional<int>> firsts(lanes);
+    vector<optional<int>> seconds(lanes);
+    for(size_t lane = 0; lane < lanes; ++lane){
+        if(lane % 7 != 0) firsts[lane] = static_cast<int>(lane % 1000);
+        seconds[lane] = static_cast<int>(lane % 5);
+    }
+
+    const long long expected = timePerUnit("optional per stage: ", lanes, "lane", [&](){
+        auto plusOptional = [](const optional<int> first, const optional<int> second) -> optional<int>{
+            return (first == nullopt || second == nullopt) ? nullopt : make_optional(first.value() + second.value());
+        };
+        auto positiveOptional = [](const optional<int> value) -> optional<int>{
+            return (value == nullopt || value.value() <= 0) ? nullopt : value;
+        };
+        auto scaleOptional = [](const optional<int> value) -> optional<int>{
+            return (value == nullopt) ? nullopt : make_optional(3 * value.value() + 1);
+        };
+        long long sum = 0;
+        for(size_t lane = 0; lane < lanes; ++lane) sum += scaleOptional(positiveOptional(plusOptional(firsts[lane], seconds[lane]))).value_or(0);
+        return sum;
+    });
+
+    CHECK_EQ(expected, timePerUnit("chain of stages: ", lanes, "lane", [&](){
+        auto pipeline = chain(
+            [&](const size_t lane) -> optional<int>{
+                return (firsts[lane] == nullopt || seconds[lane] == nullopt) ? nullopt : make_optional(*firsts[lane] + *seconds[lane]);
+            },
+            [](const int value) -> optional<int>{ return (value <= 0) ? nullopt : make_optional(value); },
+            [](const int value){ return 3 * value + 1; });
+        long long sum = 0;
+        for(size_t lane = 0; lane < lanes; ++lane) sum += pipeline(lane).value_or(0);
+        return sum;
+    }));
+
+    const auto first = MaybeBatch<int>::fromOptionals(firsts);
+    const auto second = MaybeBatch<int>::fromOptionals(seconds);
+    auto sumOfValid = [lanes](const MaybeBatch<int>& results){
+        long long sum = 0;
+        for(size_t lane = 0; lane < lanes; ++lane) sum += results.valid[lane] * results.values[lane];
+        return sum;
+    };
+    CHECK_EQ(expected, timePerUnit("batch with validity mask, new batches per stage: ", lanes, "lane", [&](){
+        const auto combined = combineBatch(first, second, plus<int>());
+        const auto positive = filterBatch(combined, [](int value){ return value > 0; }, 0);
+        return sumOfValid(transformBatch(positive, [](int value){ return 3 * value + 1; }));
+    }));
+    MaybeBatch<int> results;
+    CHECK_EQ(expected, timePerUnit("batch with validity mask, reusing one batch: ", lanes, "lane", [&](){
+        combineBatch(first, second, plus<int>(), results);
+        filterBatch(results, [](int value){ return value > 0; }, 0, results);
+        transformBatch(results, [](int value){ return 3 * value + 1; }, results);
+        return sumOfValid(results);
+    }));
+}
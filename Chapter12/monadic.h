@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+// The error of a failed expected, kept apart so that expected<int, int> can
+// tell its value from its error.
+template<typename E>
+struct Unexpected{
+    E error;
+};
+
+template<typename E>
+Unexpected<decay_t<E>> makeUnexpected(E&& error){
+    return Unexpected<decay_t<E>>{forward<E>(error)};
+}
+
+template<typename E>
+class BadExpectedAccess : public logic_error{
+    public:
+        E error;
+        explicit BadExpectedAccess(E error) : logic_error("expected holds an error"), error(move(error)){}
+};
+
+// Either a T or the E explaining why there is none.
+template<typename T, typename E>
+class expected{
+    private:
+        variant<T, E> storage;
+
+    public:
+        typedef T value_type;
+        typedef E error_type;
+
+        expected(const T& value) : storage(in_place_index<0>, value){}
+        expected(T&& value) : storage(in_place_index<0>, move(value)){}
+
+        template<typename G>
+        expected(Unexpected<G> failure) : storage(in_place_index<1>, move(failure.error)){}
+
+        bool has_value() const{
+            return storage.index() == 0;
+        }
+
+        explicit operator bool() const{
+            return has_value();
+        }
+
+        const T& value() const&{
+            if(!has_value()) throw BadExpectedAccess<E>(error());
+            return *get_if<0>(&storage);
+        }
+
+        T&& value() &&{
+            if(!has_value()) throw BadExpectedAccess<E>(error());
+            return move(*get_if<0>(&storage));
+        }
+
+        const T& operator*() const&{ return *get_if<0>(&storage); }
+        T&& operator*() &&{ return move(*get_if<0>(&storage)); }
+
+        const E& error() const{
+            return *get_if<1>(&storage);
+        }
+
+        template<typename U>
+        T value_or(U&& fallback) const{
+            return has_value() ? **this : static_cast<T>(forward<U>(fallback));
+        }
+
+        bool operator==(const expected& other) const{
+            return storage == other.storage;
+        }
+};
+
+template<typename M>
+struct IsMonadic : false_type{};
+
+template<typename T>
+struct IsMonadic<optional<T>> : true_type{};
+
+template<typename T, typename E>
+struct IsMonadic<expected<T, E>> : true_type{};
+
+// The failure of `from` as a Result: nullopt, or the same error.
+template<typename Result, typename T>
+Result failureOf(const optional<T>&){
+    return nullopt;
+}
+
+template<typename Result, typename T, typename E>
+Result failureOf(const expected<T, E>& from){
+    return makeUnexpected(from.error());
+}
+
+// and_then, transform and or_else as free functions, for optional and expected
+// alike. and_then expects f to return an optional or expected itself.
+template<typename M, typename F, typename = enable_if_t<IsMonadic<decay_t<M>>::value>>
+auto and_then(M&& monadic, F f){
+    typedef decay_t<decltype(f(*forward<M>(monadic)))> Result;
+    if(!monadic) return failureOf<Result>(monadic);
+    return Result(f(*forward<M>(monadic)));
+}
+
+template<typename T, typename F>
+auto transform(const optional<T>& value, F f) -> optional<decay_t<decltype(f(*value))>>{
+    if(!value) return nullopt;
+    return f(*value);
+}
+
+template<typename T, typename E, typename F>
+auto transform(const expected<T, E>& value, F f) -> expected<decay_t<decltype(f(*value))>, E>{
+    if(!value) return makeUnexpected(value.error());
+    return f(*value);
+}
+
+template<typename T, typename F>
+optional<T> or_else(const optional<T>& value, F f){
+    return value ? value : f();
+}
+
+template<typename T, typename E, typename F>
+expected<T, E> or_else(const expected<T, E>& value, F f){
+    return value ? value : f(value.error());
+}
+
+// Composes stages into one callable: chain(f, g, h)(x) is h(g(f(x))), except
+// that the first stage returning an empty optional or an error ends it, and
+// that failure is the result. A stage returning a plain value cannot fail. The
+// stages are nested lambdas, so the compiler sees one function with an early
+// exit per fallible stage instead of an optional built and tested per stage.
+template<typename F, typename Next, typename Input>
+auto chainStep(const F& f, const Next& next, Input&& input){
+    auto result = f(forward<Input>(input));
+    if constexpr(IsMonadic<decltype(result)>::value){
+        typedef decltype(next(*move(result))) NextResult;
+        typedef conditional_t<IsMonadic<NextResult>::value, NextResult, decltype(transform(result, next))> Result;
+        if(!result) return failureOf<Result>(result);
+        return Result(next(*move(result)));
+    } else {
+        return next(move(result));
+    }
+}
+
+template<typename F>
+auto chain(F f){
+    return f;
+}
+
+template<typename F, typename G, typename... Rest>
+auto chain(F f, G g, Rest... rest){
+    auto next = chain(g, rest...);
+    return [f, next](auto&& input){
+        return chainStep(f, next, forward<decltype(input)>(input));
+    };
+}
+
+// Many optionals of one type as two arrays: the values and a validity mask.
+// Every lane holds a value, valid or not; an invalid lane holds a placeholder
+// that the operations are safe to run on. The operations below then run f on
+// every lane and combine masks with &, with no branch per lane, so the loops
+// vectorize and a failure costs no more than a success.
+template<typename T>
+struct MaybeBatch{
+    vector<T> values;
+    vector<uint8_t> valid;
+
+    size_t size() const{
+        return values.size();
+    }
+
+    static MaybeBatch fromOptionals(const vector<optional<T>>& optionals, const T placeholder = T()){
+        MaybeBatch batch;
+        batch.values.reserve(optionals.size());
+        batch.valid.reserve(optionals.size());
+        for(const optional<T>& value : optionals){
+            batch.values.push_back(value.value_or(placeholder));
+            batch.valid.push_back(value.has_value());
+        }
+        return batch;
+    }
+
+    vector<optional<T>> toOptionals() const{
+        vector<optional<T>> optionals;
+        optionals.reserve(size());
+        for(size_t lane = 0; lane < size(); ++lane){
+            optionals.push_back(valid[lane] ? optional<T>(values[lane]) : nullopt);
+        }
+        return optionals;
+    }
+};
+
+// Each operation writes into `result`, which may be one of its inputs: a
+// pipeline run into the same batch again and again allocates nothing once the
+// batch has grown. The overloads without `result` return a new batch.
+
+// f on every lane; f must be total, since it also sees the placeholders.
+template<typename T, typename R, typename F>
+void transformBatch(const MaybeBatch<T>& batch, F f, MaybeBatch<R>& result){
+    result.values.resize(batch.size());
+    result.valid.resize(batch.size());
+    const T* values = batch.values.data();
+    const uint8_t* valid = batch.valid.data();
+    R* output = result.values.data();
+    uint8_t* outputValid = result.valid.data();
+    for(size_t lane = 0; lane < batch.size(); ++lane){
+        output[lane] = f(values[lane]);
+        outputValid[lane] = valid[lane];
+    }
+}
+
+template<typename T, typename F>
+auto transformBatch(const MaybeBatch<T>& batch, F f){
+    MaybeBatch<decay_t<decltype(f(batch.values[0]))>> result;
+    transformBatch(batch, f, result);
+    return result;
+}
+
+template<typename T, typename U, typename R, typename F>
+void combineBatch(const MaybeBatch<T>& first, const MaybeBatch<U>& second, F f, MaybeBatch<R>& result){
+    if(first.size() != second.size()) throw invalid_argument("batches of different sizes");
+    result.values.resize(first.size());
+    result.valid.resize(first.size());
+    const T* firstValues = first.values.data();
+    const U* secondValues = second.values.data();
+    const uint8_t* firstValid = first.valid.data();
+    const uint8_t* secondValid = second.valid.data();
+    R* output = result.values.data();
+    uint8_t* outputValid = result.valid.data();
+    for(size_t lane = 0; lane < first.size(); ++lane){
+        output[lane] = f(firstValues[lane], secondValues[lane]);
+        outputValid[lane] = firstValid[lane] & secondValid[lane];
+    }
+}
+
+template<typename T, typename U, typename F>
+auto combineBatch(const MaybeBatch<T>& first, const MaybeBatch<U>& second, F f){
+    MaybeBatch<decay_t<decltype(f(first.values[0], second.values[0]))>> result;
+    combineBatch(first, second, f, result);
+    return result;
+}
+
+// The and_then of a batch: lanes failing `keep` become invalid and get the
+// placeholder, so later stages never see the value that failed, such as a
+// zero divisor.
+template<typename T, typename P>
+void filterBatch(const MaybeBatch<T>& batch, P keep, const T placeholder, MaybeBatch<T>& result){
+    result.values.resize(batch.size());
+    result.valid.resize(batch.size());
+    const T* values = batch.values.data();
+    const uint8_t* valid = batch.valid.data();
+    T* output = result.values.data();
+    uint8_t* outputValid = result.valid.data();
+    for(size_t lane = 0; lane < batch.size(); ++lane){
+        const T value = values[lane];
+        const uint8_t kept = valid[lane] & static_cast<uint8_t>(keep(value));
+        outputValid[lane] = kept;
+        output[lane] = kept ? value : placeholder;
+    }
+}
+
+template<typename T, typename P>
+MaybeBatch<T> filterBatch(const MaybeBatch<T>& batch, P keep, const T placeholder){
+    MaybeBatch<T> result;
+    filterBatch(batch, keep, placeholder, result);
+    return result;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "billing.h"
+
+using namespace std;
+
+// One immutable version of the catalog. Ids are handed out once per drink name
+// and keep their meaning in every later version, so orders resolved against
+// one snapshot can be billed with any newer one.
+struct PriceSnapshot{
+    uint64_t version = 0;
+    unordered_map<string_view, DrinkId> ids;
+    vector<double> prices;
+
+    const DrinkId* find(const string_view name) const{
+        const auto found = ids.find(name);
+        return (found == ids.end()) ? nullptr : &found->second;
+    }
+
+    DrinkId idOf(const string_view name) const{
+        const DrinkId* id = find(name);
+        if(id == nullptr) throw out_of_range(string(name) + " is not in the catalog");
+        return *id;
+    }
+
+    double priceOf(const string_view name) const{
+        return prices[idOf(name)];
+    }
+
+    const double* priceTable() const{
+        return prices.data();
+    }
+};
+
+// Drink prices that change while billing threads keep reading them, RCU style.
+// A writer copies the current snapshot, changes the copy and publishes it with
+// one atomic exchange; readers are never blocked by writers nor by each other.
+//
+// Old snapshots are reclaimed by epoch: a reader announces the epoch it starts
+// reading in, in a slot of its own, before loading the snapshot pointer. A
+// snapshot retired in epoch e is freed once no slot holds an epoch <= e, since
+// only readers that announced such an epoch can have loaded it.
+class PriceCatalog{
+    public:
+        static constexpr size_t maxReaders = 64;
+
+    private:
+        struct alignas(64) ReaderSlot{
+            atomic<bool> claimed{false};
+            atomic<uint64_t> epoch{0};
+        };
+
+        atomic<const PriceSnapshot*> current;
+        atomic<uint64_t> epoch{1};
+        array<ReaderSlot, maxReaders> readers;
+
+        mutex writer;
+        deque<string> names;
+        vector<pair<uint64_t, unique_ptr<const PriceSnapshot>>> retired;
+
+        void reclaim(){
+            uint64_t oldestActive = UINT64_MAX;
+            for(const ReaderSlot& slot : readers){
+                const uint64_t active = slot.epoch.load();
+                if(active != 0 && active < oldestActive) oldestActive = active;
+            }
+            vector<pair<uint64_t, unique_ptr<const PriceSnapshot>>> stillRead;
+            for(auto& entry : retired){
+                if(entry.first >= oldestActive) stillRead.push_back(move(entry));
+            }
+            retired = move(stillRead);
+        }
+
+    public:
+        // Everything one billing thread needs to read the catalog; holds one of
+        // the reader slots until destroyed.
+        class Reader{
+            private:
+                PriceCatalog* catalog;
+                ReaderSlot* slot;
+
+            public:
+                // The snapshot stays valid, and unchanged, for the lifetime of the
+                // guard, however many versions are published meanwhile. A reader
+                // holds one guard at a time.
+                class Guard{
+                    private:
+                        ReaderSlot* slot;
+                        const PriceSnapshot* snapshot;
+
+                    public:
+                        Guard(PriceCatalog& catalog, ReaderSlot& slot) : slot(&slot){
+                            slot.epoch.store(catalog.epoch.load());
+                            snapshot = catalog.current.load();
+                        }
+
+                        Guard(const Guard&) = delete;
+                        Guard& operator=(const Guard&) = delete;
+
+                        ~Guard(){
+                            slot->epoch.store(0, memory_order_release);
+                        }
+
+                        const PriceSnapshot& operator*() const{ return *snapshot; }
+                        const PriceSnapshot* operator->() const{ return snapshot; }
+                };
+
+                Reader(PriceCatalog& catalog, ReaderSlot& slot) : catalog(&catalog), slot(&slot){}
+
+                Reader(const Reader&) = delete;
+                Reader& operator=(const Reader&) = delete;
+
+                ~Reader(){
+                    slot->claimed.store(false, memory_order_release);
+                }
+
+                Guard read() const{
+                    return Guard(*catalog, *slot);
+                }
+        };
+
+        PriceCatalog(){
+            current.store(new PriceSnapshot());
+        }
+
+        PriceCatalog(const initializer_list<pair<string, double>> prices) : PriceCatalog(){
+            update(vector<pair<string, double>>(prices));
+        }
+
+        PriceCatalog(const PriceCatalog&) = delete;
+        PriceCatalog& operator=(const PriceCatalog&) = delete;
+
+        // Readers must be gone by now.
+        ~PriceCatalog(){
+            delete current.load();
+        }
+
+        Reader reader(){
+            for(ReaderSlot& slot : readers){
+                bool expected = false;
+                if(slot.claimed.compare_exchange_strong(expected, true, memory_order_acquire)) return Reader(*this, slot);
+            }
+            throw runtime_error("more than " + to_string(maxReaders) + " catalog readers");
+        }
+
+        // Publishes one new version holding all of `prices`; a drink not in the
+        // catalog yet gets the next id. Returns the new version number.
+        uint64_t update(const vector<pair<string, double>>& prices){
+            lock_guard<mutex> lock(writer);
+            const PriceSnapshot* previous = current.load();
+            auto next = make_unique<PriceSnapshot>(*previous);
+            ++next->version;
+            for(const auto& [name, price] : prices){
+                const DrinkId* id = next->find(name);
+                if(id != nullptr){
+                    next->prices[*id] = price;
+                } else {
+                    names.push_back(name);
+                    next->ids.emplace(names.back(), static_cast<DrinkId>(next->prices.size()));
+                    next->prices.push_back(price);
+                }
+            }
+            const uint64_t version = next->version;
+            current.exchange(next.release());
+            retired.emplace_back(epoch.fetch_add(1), unique_ptr<const PriceSnapshot>(previous));
+            reclaim();
+            return version;
+        }
+
+        // Snapshots published but not freed yet because a reader may hold them.
+        size_t retiredCount(){
+            lock_guard<mutex> lock(writer);
+            reclaim();
+            return retired.size();
+        }
+};
@@ -1,3 +1,5 @@
+#include <array>
+#include <cstdint>
 #include <iostream>
 #include <list>
 #include <map>
@@ -6,6 +8,7 @@
 #include <numeric>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "timing.h"
 
 using namespace std;
 using namespace std::placeholders;
@@ -123,3 +126,169 @@ TEST_CASE("TicTacToe compute next board after a move with StateEvolved"){
     CHECK_EQ(Token::Blank, boardStateAfterFirstMove.value[1][1]); 
     CHECK_EQ(Token::O, boardStateAfterSecondMove.value[1][1]); 
 }
+
+// The same board in one 32 bit word, two bits per cell: cell (x, y) is at bit
+// 2 * (3x + y) and holds its Token. Copying it is copying a register.
+struct PackedBoard{
+    uint32_t cells;
+
+    static constexpr uint32_t cellShift(const int xCoord, const int yCoord){
+        return 2 * (3 * xCoord + yCoord);
+    }
+
+    Token tokenAt(const int xCoord, const int yCoord) const{
+        return static_cast<Token>((cells >> cellShift(xCoord, yCoord)) & 3u);
+    }
+};
+
+const PackedBoard EmptyPackedBoard{0};
+
+// The low bit of every cell.
+const uint32_t allCells = 0x15555;
+
+auto makePackedMove = [](const PackedBoard board, const Move move){
+    const uint32_t shift = PackedBoard::cellShift(move.xCoord, move.yCoord);
+    return PackedBoard{(board.cells & ~(3u << shift)) | (static_cast<uint32_t>(move.token) << shift)};
+};
+
+// The cells holding `token`, one low bit each: both bits of a cell are zero
+// after xor-ing with the token repeated in every cell.
+auto cellsWith = [](const PackedBoard board, const Token token){
+    const uint32_t difference = board.cells ^ (static_cast<uint32_t>(token) * allCells);
+    return ~(difference | (difference >> 1)) & allCells;
+};
+
+const array<uint32_t, 8> winningLines = [](){
+    array<uint32_t, 8> lines{};
+    for(int i = 0; i < 3; ++i){
+        for(int j = 0; j < 3; ++j){
+            lines[i] |= 1u << PackedBoard::cellShift(i, j);
+            lines[3 + i] |= 1u << PackedBoard::cellShift(j, i);
+        }
+        lines[6] |= 1u << PackedBoard::cellShift(i, i);
+        lines[7] |= 1u << PackedBoard::cellShift(i, 2 - i);
+    }
+    return lines;
+}();
+
+auto hasWon = [](const PackedBoard board, const Token token){
+    const uint32_t mine = cellsWith(board, token);
+    bool won = false;
+    for(const uint32_t line : winningLines) won |= (mine & line) == line;
+    return won;
+};
+
+// A board state is only its board: the move is the parameter of nextState, so
+// no function is stored in, or copied with, any state.
+template<>
+struct State<PackedBoard>{
+    const PackedBoard value;
+
+    State<PackedBoard> nextState(const Move move) const{
+        return State<PackedBoard>{makePackedMove(value, move)};
+    };
+};
+
+static_assert(sizeof(State<PackedBoard>) == sizeof(uint32_t));
+
+TEST_CASE("Packed TicTacToe board"){
+    const auto emptyBoardState = State<PackedBoard>{EmptyPackedBoard};
+    const auto afterFirstMove = emptyBoardState.nextState(Move{Token::X, 0, 0});
+    const auto afterSecondMove = afterFirstMove.nextState(Move{Token::O, 1, 2});
+
+    CHECK_EQ(Token::Blank, emptyBoardState.value.tokenAt(0, 0));
+    CHECK_EQ(Token::X, afterFirstMove.value.tokenAt(0, 0));
+    CHECK_EQ(Token::Blank, afterFirstMove.value.tokenAt(1, 2));
+    CHECK_EQ(Token::O, afterSecondMove.value.tokenAt(1, 2));
+    CHECK_EQ(Token::X, afterSecondMove.value.tokenAt(0, 0));
+    CHECK_EQ(allCells & ~(1u | 1u << PackedBoard::cellShift(1, 2)), cellsWith(afterSecondMove.value, Token::Blank));
+
+    PackedBoard diagonal = EmptyPackedBoard;
+    for(int i = 0; i < 3; ++i) diagonal = makePackedMove(diagonal, Move{Token::O, i, 2 - i});
+    CHECK(hasWon(diagonal, Token::O));
+    CHECK_FALSE(hasWon(diagonal, Token::X));
+    CHECK_FALSE(hasWon(afterSecondMove.value, Token::X));
+}
+
+struct GameTreeCounts{
+    size_t nodes = 0;
+    size_t games = 0;
+    size_t xWins = 0;
+    size_t oWins = 0;
+};
+
+// Every game from `state` on, `token` to move; a game ends on a win or a full board.
+void expandGameTree(const State<PackedBoard> state, const Token token, GameTreeCounts& counts){
+    ++counts.nodes;
+    const Token previous = (token == Token::X) ? Token::O : Token::X;
+    if(hasWon(state.value, previous)){
+        ++counts.games;
+        ++((previous == Token::X) ? counts.xWins : counts.oWins);
+        return;
+    }
+    uint32_t blanks = cellsWith(state.value, Token::Blank);
+    if(blanks == 0){
+        ++counts.games;
+        return;
+    }
+    while(blanks != 0){
+        const int cell = __builtin_ctz(blanks) / 2;
+        blanks &= blanks - 1;
+        expandGameTree(state.nextState(Move{token, cell / 3, cell % 3}), previous, counts);
+    }
+}
+
+TEST_CASE("Expand the whole TicTacToe game tree"){
+    GameTreeCounts counts;
+    expandGameTree(State<PackedBoard>{EmptyPackedBoard}, Token::X, counts);
+    CHECK_EQ(549946, counts.nodes);
+    CHECK_EQ(255168, counts.games);
+    CHECK_EQ(131184, counts.xWins);
+    CHECK_EQ(77904, counts.oWins);
+}
+
+auto hasWonOnVectorBoard = [](const TicTacToeBoard& board, const Token token){
+    auto line = [&](int x, int y, int dx, int dy){
+        return board[x][y] == token && board[x + dx][y + dy] == token && board[x + 2 * dx][y + 2 * dy] == token;
+    };
+    bool won = line(0, 0, 1, 1) || line(0, 2, 1, -1);
+    for(int i = 0; i < 3; ++i) won = won || line(i, 0, 0, 1) || line(0, i, 1, 0);
+    return won;
+};
+
+void expandVectorGameTree(const StateEvolved<TicTacToeBoard> state, const Token token, GameTreeCounts& counts){
+    ++counts.nodes;
+    const Token previous = (token == Token::X) ? Token::O : Token::X;
+    if(hasWonOnVectorBoard(state.value, previous)){
+        ++counts.games;
+        ++((previous == Token::X) ? counts.xWins : counts.oWins);
+        return;
+    }
+    bool full = true;
+    for(int x = 0; x < 3; ++x){
+        for(int y = 0; y < 3; ++y){
+            if(state.value[x][y] != Token::Blank) continue;
+            full = false;
+            expandVectorGameTree(state.nextState(bind(makeMove, _1, Move{token, x, y})), previous, counts);
+        }
+    }
+    if(full) ++counts.games;
+}
+
+TEST_CASE("Game tree expansion cost" * doctest::skip()){
+    const size_t states = 549946;
+    const GameTreeCounts vectorCounts = timePerUnit("vector board, StateEvolved: ", states, "state", [](){
+        GameTreeCounts counts;
+        expandVectorGameTree(StateEvolved<TicTacToeBoard>{EmptyBoard}, Token::X, counts);
+        return counts;
+    });
+    const GameTreeCounts packedCounts = timePerUnit("packed board, State<PackedBoard>: ", states, "state", [](){
+        GameTreeCounts counts;
+        expandGameTree(State<PackedBoard>{EmptyPackedBoard}, Token::X, counts);
+        return counts;
+    });
+
+    CHECK_EQ(states, vectorCounts.nodes);
+    CHECK_EQ(states, packedCounts.nodes);
+    CHECK_EQ(vectorCounts.games, packedCounts.games);
+}
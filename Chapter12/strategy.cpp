@@ -1,9 +1,15 @@
+#include <chrono>
 #include <iostream>
+#include <shared_mutex>
 #include <string>
 #include <functional>
 #include <numeric>
+#include <thread>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "billing.h"
+#include "priceCatalog.h"
+#include "timing.h"
 
 using namespace std;
 using namespace std::placeholders;
@@ -61,7 +67,7 @@ auto normalBilling = [](auto price){
 };
 
 auto computeBill = [](auto drinks, auto billingStrategy){
-    auto prices = transformAll<vector<double>>(drinks, [](auto drink){ return drinkPrices[drink]; });
+    auto prices = transformAll<vector<double>>(drinks, [](auto drink){ return drinkPrices.at(drink); });
     auto sum = accumulateAll(prices, 0.0, std::plus<double>());
     return billingStrategy(sum);
 };
@@ -108,3 +114,173 @@ TEST_CASE("Compute total bill from list of drinks, happy hour"){
 
    CHECK_EQ(expectedBill, actualBill);
 }
+
+DrinkMenu menu = {
+    {"Westmalle Tripel", 15.50},
+    {"Lagavulin 18y", 25.20},
+};
+
+TEST_CASE("Bill a batch of orders in one pass"){
+    OrderBatch batch;
+    batch.add({});
+    batch.add(menu.resolve({"Westmalle Tripel"}));
+    batch.add(menu.resolve({"Lagavulin 18y", "Westmalle Tripel", "Lagavulin 18y"}), 1);
+    batch.add(menu.resolve({"Lagavulin 18y"}), 2);
+    vector<double> bills;
+
+    SUBCASE("strategy chosen at compile time"){
+        billBatch(menu, batch, normalBilling, bills);
+        CHECK_EQ(vector<double>{0, 15.50, computeBill(vector<string>{"Lagavulin 18y", "Westmalle Tripel", "Lagavulin 18y"}, normalBilling), 25.20}, bills);
+
+        billBatch(menu, batch, happyHourBilling, bills);
+        CHECK_EQ(12.60, bills[3]);
+    }
+
+    SUBCASE("strategy chosen per order"){
+        billBatch(menu, batch, {NormalBilling(), HappyHourBilling(), DiscountBilling{10}}, bills);
+        CHECK_EQ(0, bills[0]);
+        CHECK_EQ(15.50, bills[1]);
+        CHECK_EQ(computeBill(vector<string>{"Lagavulin 18y", "Westmalle Tripel", "Lagavulin 18y"}, happyHourBilling), bills[2]);
+        CHECK_EQ(25.20 * 90 / 100, bills[3]);
+
+        CHECK_THROWS_AS(billBatch(menu, batch, {NormalBilling()}, bills), out_of_range);
+    }
+
+    SUBCASE("unknown drinks are refused when the order is taken"){
+        CHECK_THROWS_AS(menu.resolve({"Westmalle Dubbel"}), out_of_range);
+        CHECK_THROWS_AS(menu.add("Lagavulin 18y", 30), invalid_argument);
+        CHECK_EQ(2, menu.size());
+    }
+}
+
+TEST_CASE("Batch billing cost" * doctest::skip()){
+    const size_t orders = 1000000;
+    const vector<string> order = {"Westmalle Tripel", "Lagavulin 18y", "Westmalle Tripel"};
+    OrderBatch batch;
+    for(size_t i = 0; i < orders; ++i) batch.add(menu.resolve(order), i % 2);
+
+    const function<double(double)> strategies[] = {normalBilling, happyHourBilling};
+    const double expected = timePerUnit("computeBill with std::function strategy: ", orders, "order", [&](){
+        double total = 0;
+        for(size_t i = 0; i < orders; ++i) total += computeBill(order, strategies[i % 2]);
+        return total;
+    });
+
+    vector<double> bills;
+    auto sumOfBills = [&bills](){ return accumulate(bills.begin(), bills.end(), 0.0); };
+    timePerUnit("billBatch, static strategy: ", orders, "order", [&](){
+        billBatch(menu, batch, normalBilling, bills);
+        return sumOfBills();
+    });
+    CHECK_EQ(doctest::Approx(expected), timePerUnit("billBatch, variant strategy per order: ", orders, "order", [&](){
+        billBatch(menu, batch, {NormalBilling(), HappyHourBilling()}, bills);
+        return sumOfBills();
+    }));
+}
+
+TEST_CASE("Price catalog snapshots"){
+    PriceCatalog catalog = {
+        {"Westmalle Tripel", 15.50},
+        {"Lagavulin 18y", 25.20},
+    };
+    auto reader = catalog.reader();
+
+    SUBCASE("a snapshot does not change while it is read"){
+        auto before = reader.read();
+        CHECK_EQ(1, before->version);
+        CHECK_EQ(2, catalog.update({{"Westmalle Tripel", 16.00}, {"Westmalle Dubbel", 12.00}}));
+        CHECK_EQ(15.50, before->priceOf("Westmalle Tripel"));
+        CHECK(before->find("Westmalle Dubbel") == nullptr);
+        CHECK_EQ(1, catalog.retiredCount());
+    }
+
+    SUBCASE("ids keep their meaning in later versions"){
+        OrderBatch batch;
+        {
+            auto snapshot = reader.read();
+            batch.add({snapshot->idOf("Lagavulin 18y"), snapshot->idOf("Westmalle Tripel")});
+        }
+        catalog.update({{"Lagavulin 18y", 20.00}, {"Westmalle Dubbel", 12.00}});
+        auto snapshot = reader.read();
+        vector<double> bills;
+        billBatch(*snapshot, batch, normalBilling, bills);
+        CHECK_EQ(vector<double>{35.50}, bills);
+        CHECK_EQ(12.00, snapshot->priceOf("Westmalle Dubbel"));
+        CHECK_THROWS_AS(snapshot->priceOf("Orval"), out_of_range);
+        CHECK_EQ(0, catalog.retiredCount());
+    }
+
+    SUBCASE("readers see whole versions while a writer publishes"){
+        const int updates = 2000;
+        atomic<bool> inconsistent{false};
+        atomic<bool> writing{true};
+        vector<thread> readers;
+        for(int thread = 0; thread < 3; ++thread){
+            readers.emplace_back([&](){
+                auto threadReader = catalog.reader();
+                while(writing.load()){
+                    auto snapshot = threadReader.read();
+                    if(snapshot->version > 1 && snapshot->priceOf("Westmalle Tripel") != snapshot->priceOf("Lagavulin 18y")) inconsistent = true;
+                }
+            });
+        }
+        for(int update = 0; update < updates; ++update) catalog.update({{"Westmalle Tripel", double(update)}, {"Lagavulin 18y", double(update)}});
+        writing = false;
+        for(auto& aThread : readers) aThread.join();
+
+        CHECK_FALSE(inconsistent.load());
+        CHECK_EQ(updates + 1, reader.read()->version);
+        CHECK_EQ(0, catalog.retiredCount());
+    }
+}
+
+TEST_CASE("Price catalog read throughput under updates" * doctest::skip()){
+    const size_t readerThreads = max(2u, thread::hardware_concurrency());
+    const auto duration = chrono::milliseconds(500);
+    const vector<string> drinks = {"Westmalle Tripel", "Lagavulin 18y"};
+
+    auto readsPerSecond = [&](const string& name, auto read, auto update){
+        atomic<bool> running{true};
+        atomic<size_t> reads{0};
+        size_t updates = 0;
+        vector<thread> readers;
+        for(size_t thread = 0; thread < readerThreads; ++thread){
+            readers.emplace_back([&](){
+                size_t count = 0;
+                double sum = 0;
+                while(running.load(memory_order_relaxed)){
+                    sum += read(drinks[count % drinks.size()]);
+                    ++count;
+                }
+                reads += count + (sum < 0);
+            });
+        }
+        const auto end = chrono::steady_clock::now() + duration;
+        while(chrono::steady_clock::now() < end){
+            update(updates++);
+            this_thread::sleep_for(chrono::microseconds(100));
+        }
+        running = false;
+        for(auto& aThread : readers) aThread.join();
+        cout << name << static_cast<size_t>(reads / chrono::duration<double>(duration).count()) << " reads/s with " << updates << " updates" << endl;
+    };
+
+    map<string, double> lockedPrices = {{"Westmalle Tripel", 15.50}, {"Lagavulin 18y", 25.20}};
+    shared_mutex lock;
+    readsPerSecond("map behind a shared_mutex: ", [&](const string& drink){
+        shared_lock<shared_mutex> reading(lock);
+        return lockedPrices.at(drink);
+    }, [&](size_t update){
+        unique_lock<shared_mutex> writing(lock);
+        lockedPrices["Westmalle Tripel"] = 15.50 + update % 10;
+    });
+
+    PriceCatalog catalog = {{"Westmalle Tripel", 15.50}, {"Lagavulin 18y", 25.20}};
+    readsPerSecond("price catalog snapshots: ", [&catalog](const string& drink){
+        thread_local auto reader = catalog.reader();
+        return reader.read()->priceOf(drink);
+    }, [&](size_t update){
+        catalog.update({{"Westmalle Tripel", 15.50 + update % 10}});
+    });
+    CHECK_EQ(0, catalog.retiredCount());
+}
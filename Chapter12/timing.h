@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// How timePerUnit runs the code it measures: `warmups` runs are not timed, so
+// caches, branch predictors and the allocator have settled by the time the
+// `repetitions` timed runs start.
+struct TimingOptions{
+    size_t warmups = 1;
+    size_t repetitions = 5;
+};
+
+// Times f, which does `units` units of work, e.g. bills a million orders, and
+// prints the median cost of one unit over the timed runs, with the fastest and
+// the slowest run. Returns what the last run of f returned, so the caller can
+// check that every variant computed the same thing and the compiler cannot
+// drop the work.
+auto timePerUnit = [](const string& name, const size_t units, const string& unit, auto f, const TimingOptions options = TimingOptions()){
+    typedef decltype(f()) Result;
+    auto timed = [&f](auto& result){
+        const auto start = chrono::steady_clock::now();
+        if constexpr(is_void<Result>::value) f();
+        else result = f();
+        const chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        return elapsed.count();
+    };
+
+    conditional_t<is_void<Result>::value, bool, Result> result{};
+    for(size_t run = 0; run < options.warmups; ++run) timed(result);
+    vector<double> nanosecondsPerUnit;
+    for(size_t run = 0; run < max<size_t>(options.repetitions, 1); ++run) nanosecondsPerUnit.push_back(timed(result) / units);
+
+    sort(nanosecondsPerUnit.begin(), nanosecondsPerUnit.end());
+    cout << name << nanosecondsPerUnit[nanosecondsPerUnit.size() / 2] << " ns/" << unit
+        << " (fastest " << nanosecondsPerUnit.front() << ", slowest " << nanosecondsPerUnit.back()
+        << ", " << nanosecondsPerUnit.size() << " runs)" << endl;
+    if constexpr(!is_void<Result>::value) return result;
+};